@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <generator.hpp>
+#include <logger.hpp>
+#include <snapshot.hpp>
+#include <thread>
+
+using suex::permissions::Snapshots;
+
+// shared by the threads of BM_GetConcurrent
+struct concurrent_t {
+  std::unique_ptr<SyntheticConfig> conf;
+  std::unique_ptr<Snapshots> snapshots;
+  std::thread reloader;
+  std::atomic<bool> stop{false};
+};
+
+concurrent_t concurrent;
+
+// state.range(0) rules. the policy is reloaded continuously by another
+// thread if state.range(1) is set.
+void SetupConcurrent(const benchmark::State &state) {
+  config_t config{};
+  config.rules = state.range(0);
+  concurrent.conf = std::make_unique<SyntheticConfig>(config);
+  concurrent.snapshots = std::make_unique<Snapshots>(concurrent.conf->Path(),
+                                                     DEFAULT_AUTH_STYLE);
+  concurrent.stop = false;
+  if (state.range(1) != 0) {
+    concurrent.reloader = std::thread([] {
+      while (!concurrent.stop) {
+        concurrent.snapshots->Reload();
+      }
+    });
+  }
+}
+
+void TeardownConcurrent(const benchmark::State &) {
+  concurrent.stop = true;
+  if (concurrent.reloader.joinable()) {
+    concurrent.reloader.join();
+  }
+  concurrent.snapshots.reset();
+  concurrent.conf.reset();
+}
+
+// Get from every thread, each one following the published generations
+void BM_GetConcurrent(benchmark::State &state) {
+  Snapshots::Reader reader{*concurrent.snapshots};
+  std::vector<char *> cmdargv{CommandArguments(*concurrent.conf)};
+  uint64_t first{concurrent.snapshots->Generation()};
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(reader.Get().Get(RootUser(), cmdargv));
+  }
+
+  if (state.thread_index() == 0) {
+    state.counters["generations"] =
+        static_cast<double>(concurrent.snapshots->Generation() - first);
+  }
+}
+
+BENCHMARK(BM_GetConcurrent)
+    ->Setup(SetupConcurrent)
+    ->Teardown(TeardownConcurrent)
+    ->ArgNames({"rules", "reload"})
+    ->Args({256, 0})
+    ->Args({256, 1})
+    ->Args({4096, 0})
+    ->Args({4096, 1})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
@@ -0,0 +1,110 @@
+#include <pwd.h>
+#include <sys/stat.h>
+#include <file.hpp>
+#include <generator.hpp>
+#include <logger.hpp>
+#include <sstream>
+#include <utils.hpp>
+
+// the running user first, so the rules always apply to it
+std::vector<std::string> Members(int64_t size) {
+  std::vector<std::string> users{RunningUser().Name()};
+  setpwent();
+  DEFER(endpwent());
+  for (passwd *pw = getpwent(); pw != nullptr; pw = getpwent()) {
+    if (pw->pw_name != users.front()) {
+      users.emplace_back(pw->pw_name);
+    }
+  }
+
+  std::vector<std::string> members;
+  for (int64_t i = 0; i < size; i++) {
+    members.emplace_back(users[i % users.size()]);
+  }
+  return members;
+}
+
+SyntheticConfig::SyntheticConfig(const config_t &config) {
+  if (config.glob_fanout > 0) {
+    char dir[] = "/tmp/suex-bench-bin-XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+      throw suex::IOError("mkdtemp() failed: %s", std::strerror(errno));
+    }
+    glob_dir_ = dir;
+
+    for (int64_t i = 0; i < config.glob_fanout; i++) {
+      std::string exe{glob_dir_ + "/exe" + std::to_string(i)};
+      file::File{exe, O_CREAT | O_WRONLY, S_IRWXU | S_IRGRP | S_IXGRP};
+      executables_.emplace_back(exe);
+    }
+  }
+
+  char path[] = "/tmp/suex-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    throw suex::IOError("mkstemp() failed: %s", std::strerror(errno));
+  }
+  path_ = path;
+  file::File f{fd};
+
+  std::vector<std::string> members{Members(config.group_size)};
+  std::string cmd{config.glob_fanout > 0 ? glob_dir_ + "/*" : "/bin/sh"};
+  std::ostringstream ss;
+  for (int64_t i = 0; i < config.rules; i++) {
+    std::string job{config.identical ? "job" : "job" + std::to_string(i)};
+
+    std::ostringstream options;
+    if (i % 100 < config.setenv_percent) {
+      options << "setenv { ";
+      for (int64_t j = 0; j < config.setenv_vars; j++) {
+        options << "SUEX_BENCH" << j << "=" << job << " ";
+      }
+      options << "-HOME } ";
+    }
+
+    std::ostringstream args;
+    for (int64_t j = 0; j < config.args_alternatives; j++) {
+      args << (j == 0 ? " args -c (" : "|") << job << "_" << j;
+    }
+    if (config.args_alternatives > 0) {
+      args << ")";
+    }
+
+    for (const std::string &member : members) {
+      ss << "permit " << options.str() << member << " as root cmd " << cmd
+         << args.str() << std::endl;
+      lines_++;
+    }
+
+    if (i == config.rules - 1) {
+      command_.emplace_back(executables_.empty() ? cmd : executables_.back());
+      if (config.args_alternatives > 0) {
+        command_.emplace_back("-c");
+        command_.emplace_back(job + "_" +
+                              std::to_string(config.args_alternatives - 1));
+      }
+    }
+  }
+
+  std::string txt{ss.str()};
+  f.Write(gsl::make_span(txt.c_str(), txt.size()));
+}
+
+SyntheticConfig::~SyntheticConfig() {
+  unlink(path_.c_str());
+  for (const std::string &exe : executables_) {
+    unlink(exe.c_str());
+  }
+  if (!glob_dir_.empty()) {
+    rmdir(glob_dir_.c_str());
+  }
+}
+
+std::vector<char *> CommandArguments(const SyntheticConfig &conf) {
+  std::vector<char *> cmdargv;
+  for (const std::string &arg : conf.Command()) {
+    cmdargv.emplace_back(utils::ConstCorrect(arg.c_str()));
+  }
+  cmdargv.emplace_back(nullptr);
+  return cmdargv;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the shape of a synthetic configuration. rules are written for the running
+// user, as root, so every one of them is loaded & can be matched.
+struct config_t {
+  // number of rules in the configuration
+  int64_t rules{1024};
+  // every rule is written once per member of a group of this size, which is
+  // what a ':group' rule expands to. the members are the system's users,
+  // since the benchmarks can't create groups.
+  int64_t group_size{1};
+  // number of executables the command glob of every rule matches.
+  // 0 doesn't use globs.
+  int64_t glob_fanout{0};
+  // number of alternatives in the args regex of every rule.
+  // 0 doesn't use args.
+  int64_t args_alternatives{1};
+  // percentage of rules with a setenv option, and the variables it sets
+  int64_t setenv_percent{0};
+  int64_t setenv_vars{1};
+  // all rules share the same command, which is what group & glob expansion
+  // produce
+  bool identical{false};
+};
+
+// a configuration file (and the executables its globs match) that's removed
+// when it goes out of scope
+class SyntheticConfig {
+ public:
+  explicit SyntheticConfig(const config_t &config);
+  SyntheticConfig(const SyntheticConfig &) = delete;
+  ~SyntheticConfig();
+  void operator=(const SyntheticConfig &) = delete;
+
+  const std::string &Path() const { return path_; }
+
+  size_t Lines() const { return lines_; }
+
+  // a command line that's permitted by the last rule of the configuration
+  const std::vector<std::string> &Command() const { return command_; }
+
+ private:
+  std::string path_{};
+  std::string glob_dir_{};
+  std::vector<std::string> executables_{};
+  std::vector<std::string> command_{};
+  size_t lines_{0};
+};
+
+// the arguments of conf's command, as Permissions::Get takes them
+std::vector<char *> CommandArguments(const SyntheticConfig &conf);
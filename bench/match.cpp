@@ -0,0 +1,86 @@
+#include <benchmark/benchmark.h>
+#include <conf.hpp>
+#include <generator.hpp>
+#include <logger.hpp>
+
+using suex::permissions::Entity;
+using suex::permissions::Permissions;
+
+void BM_Get(benchmark::State &state, bool identical) {
+  config_t config{};
+  config.rules = state.range(0);
+  config.identical = identical;
+  SyntheticConfig conf{config};
+
+  auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+  std::vector<char *> cmdargv{CommandArguments(conf)};
+
+  // the first lookup compiles the rules, measure the steady state
+  perms.Get(RootUser(), cmdargv);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(perms.Get(RootUser(), cmdargv));
+  }
+  state.counters["entities"] = perms.Size();
+  state.SetComplexityN(state.range(0));
+}
+
+// the first lookup, which builds the matcher of the running user
+void BM_GetFirst(benchmark::State &state) {
+  config_t config{};
+  config.rules = state.range(0);
+  SyntheticConfig conf{config};
+  std::vector<char *> cmdargv{CommandArguments(conf)};
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(perms.Get(RootUser(), cmdargv));
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BM_GetArgs(benchmark::State &state) {
+  config_t config{};
+  config.rules = 256;
+  config.args_alternatives = state.range(0);
+  SyntheticConfig conf{config};
+
+  auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+  std::vector<char *> cmdargv{CommandArguments(conf)};
+
+  perms.Get(RootUser(), cmdargv);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(perms.Get(RootUser(), cmdargv));
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BM_CanExecute(benchmark::State &state) {
+  config_t config{};
+  config.rules = 1;
+  config.args_alternatives = state.range(0);
+  SyntheticConfig conf{config};
+
+  auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+  const Entity &e{*(perms.end() - 1)};
+  std::vector<char *> cmdargv{CommandArguments(conf)};
+  std::string cmdtxt{utils::CommandArgsText(cmdargv)};
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(e.CanExecute(RootUser(), cmdtxt));
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK_CAPTURE(BM_Get, unique, false)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+BENCHMARK_CAPTURE(BM_Get, identical, true)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+BENCHMARK(BM_GetFirst)->RangeMultiplier(4)->Range(16, 4096)->Complexity();
+BENCHMARK(BM_GetArgs)->RangeMultiplier(4)->Range(1, 256)->Complexity();
+BENCHMARK(BM_CanExecute)->RangeMultiplier(4)->Range(1, 256)->Complexity();
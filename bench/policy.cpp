@@ -0,0 +1,170 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <actions.hpp>
+#include <cache.hpp>
+#include <conf.hpp>
+#include <fstream>
+#include <generator.hpp>
+#include <logger.hpp>
+
+using suex::permissions::Entity;
+using suex::permissions::Permissions;
+using suex::permissions::PolicyCache;
+using suex::permissions::rule_t;
+
+void Load(benchmark::State &state, const config_t &config) {
+  SyntheticConfig conf{config};
+
+  size_t entities{0};
+  for (auto _ : state) {
+    auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+    entities = perms.Size();
+  }
+  state.counters["lines"] = conf.Lines();
+  state.counters["entities"] = entities;
+  state.counters["entities_rate"] = benchmark::Counter(
+      entities * state.iterations(), benchmark::Counter::kIsRate);
+  state.SetComplexityN(state.range(0));
+}
+
+void BM_Load(benchmark::State &state) {
+  config_t config{};
+  config.rules = state.range(0);
+  Load(state, config);
+}
+
+void BM_LoadGroups(benchmark::State &state) {
+  config_t config{};
+  config.rules = 256;
+  config.group_size = state.range(0);
+  Load(state, config);
+}
+
+void BM_LoadGlobs(benchmark::State &state) {
+  config_t config{};
+  config.rules = 256;
+  config.glob_fanout = state.range(0);
+  Load(state, config);
+}
+
+void BM_LoadSetenv(benchmark::State &state) {
+  config_t config{};
+  config.rules = 1024;
+  config.setenv_percent = state.range(0);
+  Load(state, config);
+}
+
+// the environment of a rule that sets state.range(0) variables.
+// freeing the variables is measured as well.
+void BM_Env(benchmark::State &state) {
+  config_t config{};
+  config.rules = 1;
+  config.setenv_percent = 100;
+  config.setenv_vars = state.range(0);
+  SyntheticConfig conf{config};
+
+  auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+  const Entity &e{*(perms.end() - 1)};
+
+  std::vector<char *> vec;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(suex::GetEnv(&vec, e, suex::env::Raw()));
+    for (char *ev : vec) {
+      free(ev);
+    }
+    vec.clear();
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+// the rules of a configuration, as suex gets them: from the policy cache
+// (state.range(1) == 1), which is keyed by the file's stat, or by copying &
+// tokenizing the file. the cache is written by root only.
+void BM_ReadRules(benchmark::State &state) {
+  config_t config{};
+  config.rules = state.range(0);
+  SyntheticConfig conf{config};
+  suex::file::File f{conf.Path(), O_RDONLY | O_CLOEXEC};
+  bool cached{state.range(1) == 1};
+
+  std::vector<rule_t> rules;
+  auto tokenize = [&] {
+    suex::file::Mapping mapping{f.Copy()};
+    mapping.ReadLine([&](const suex::file::line_t &line) {
+      rule_t rule{};
+      if (suex::permissions::Tokenize(line.txt, line.lineno, &rule)) {
+        rules.emplace_back(rule);
+      }
+    });
+  };
+
+  std::string cache_path{PolicyCache{f}.Path()};
+  DEFER(unlink(cache_path.c_str()));
+  if (cached) {
+    tokenize();
+    PolicyCache{f}.Write(rules);
+    if (!PolicyCache{f}.Read(&rules)) {
+      state.SkipWithError("the policy cache is written by root only");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    rules.clear();
+    if (cached) {
+      PolicyCache cache{f};
+      benchmark::DoNotOptimize(cache.Read(&rules));
+    } else {
+      tokenize();
+    }
+  }
+  state.counters["rules"] = rules.size();
+  state.SetComplexityN(state.range(0));
+}
+
+// suex -l, to a discarded stdout
+void BM_List(benchmark::State &state) {
+  config_t config{};
+  config.rules = state.range(0);
+  SyntheticConfig conf{config};
+
+  auto perms{Permissions(conf.Path(), DEFAULT_AUTH_STYLE).Load()};
+
+  std::ofstream devnull{"/dev/null"};
+  std::streambuf *stdout_buf{std::cout.rdbuf(devnull.rdbuf())};
+  DEFER(std::cout.rdbuf(stdout_buf));
+  for (auto _ : state) {
+    suex::ShowPermissions(perms);
+  }
+  state.counters["entities"] = perms.Size();
+  state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK(BM_Load)
+    ->RangeMultiplier(4)
+    ->Range(256, 65536)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity();
+BENCHMARK(BM_ReadRules)
+    ->ArgsProduct({benchmark::CreateRange(256, 65536, 4), {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadGroups)
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity();
+BENCHMARK(BM_LoadGlobs)
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity();
+BENCHMARK(BM_LoadSetenv)
+    ->DenseRange(0, 100, 25)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Env)->RangeMultiplier(4)->Range(1, 256)->Complexity();
+BENCHMARK(BM_List)
+    ->RangeMultiplier(4)
+    ->Range(256, 16384)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity();
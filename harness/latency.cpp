@@ -0,0 +1,369 @@
+// suex_latency measures the wall time of full suex invocations, and breaks it
+// down to phases using the timings suex_harness reports.
+//
+// it runs in a private mount namespace, where /etc is replaced by a copy with
+// fake users & groups, a pam_permit policy and the configuration under test,
+// so nothing on the machine itself is touched. it has to run as root.
+#include <fcntl.h>
+#include <getopt.h>
+#include <grp.h>
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CALLER_NAME "suex-caller"
+#define CALLER_ID 4240
+#define TARGET_NAME "suex-target"
+#define TARGET_ID 4241
+
+struct options_t {
+  int iterations{1000};
+  int warmup{20};
+  std::string binary{};
+  std::string config{};
+  std::string passwd{};
+  std::string group{};
+  std::string target{TARGET_NAME};
+  bool json{false};
+  std::vector<std::string> cmdargv{};
+};
+
+// phase -> nanoseconds of every invocation, in the order they're reported
+typedef std::vector<std::pair<std::string, std::vector<int64_t>>> samples_t;
+
+int64_t Now() {
+  timespec ts{0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void Check(bool ok, const std::string &what) {
+  if (!ok) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+  }
+}
+
+void WriteFile(const std::string &path, const std::string &txt,
+               mode_t mode = 0644) {
+  std::ofstream f{path, std::ios::trunc};
+  f << txt;
+  f.close();
+  Check(!f.fail(), "couldn't write " + path);
+  Check(chmod(path.c_str(), mode) == 0, "chmod " + path);
+}
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream f{path};
+  Check(f.good(), "couldn't read " + path);
+  std::ostringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+void ShowUsage() {
+  std::cerr << "usage: suex_latency [-n iterations] [-w warmup] [-b suex] "
+               "[-c config] [-p passwd] [-g group] [-u user] [-j] "
+               "[command [args]]"
+            << std::endl;
+}
+
+options_t ParseOptions(int argc, char *argv[]) {
+  options_t opts;
+  std::string self{argv[0]};
+  opts.binary = self.substr(0, self.rfind('/') + 1) + "suex_harness";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "+n:w:b:c:p:g:u:jh")) != -1) {
+    switch (opt) {
+      case 'n':
+        opts.iterations = std::stoi(optarg);
+        break;
+      case 'w':
+        opts.warmup = std::stoi(optarg);
+        break;
+      case 'b':
+        opts.binary = optarg;
+        break;
+      case 'c':
+        opts.config = optarg;
+        break;
+      case 'p':
+        opts.passwd = optarg;
+        break;
+      case 'g':
+        opts.group = optarg;
+        break;
+      case 'u':
+        opts.target = optarg;
+        break;
+      case 'j':
+        opts.json = true;
+        break;
+      default:
+        ShowUsage();
+        exit(1);
+    }
+  }
+
+  for (int i = optind; i < argc; i++) {
+    opts.cmdargv.emplace_back(argv[i]);
+  }
+  if (opts.cmdargv.empty()) {
+    opts.cmdargv.emplace_back("/bin/true");
+  }
+  return opts;
+}
+
+// the caller runs suex, the target is who it runs the command as
+std::string FakePasswd() {
+  std::ostringstream ss;
+  ss << "root:x:0:0:root:/root:/bin/sh\n"
+     << CALLER_NAME ":x:" << CALLER_ID << ":" << CALLER_ID
+     << "::/nonexistent:/bin/sh\n"
+     << TARGET_NAME ":x:" << TARGET_ID << ":" << TARGET_ID
+     << "::/nonexistent:/bin/sh\n";
+  return ss.str();
+}
+
+std::string FakeGroup() {
+  std::ostringstream ss;
+  ss << "root:x:0:\n"
+     << "wheel:x:10:\n"
+     << CALLER_NAME ":x:" << CALLER_ID << ":\n"
+     << TARGET_NAME ":x:" << TARGET_ID << ":\n";
+  return ss.str();
+}
+
+// permits the caller to run the command as the target, with a password
+// prompt, so PAM is part of every invocation
+std::string DefaultConfig(const options_t &opts) {
+  std::ostringstream ss;
+  ss << "permit " CALLER_NAME " as " << opts.target << " cmd "
+     << opts.cmdargv.front();
+  for (size_t i = 1; i < opts.cmdargv.size(); i++) {
+    ss << (i == 1 ? " args " : " ") << opts.cmdargv[i];
+  }
+  ss << std::endl;
+  return ss.str();
+}
+
+// builds the private root & mounts it. returns the path of the suex binary
+std::string Isolate(const std::string &root, const options_t &opts) {
+  Check(unshare(CLONE_NEWNS) == 0, "unshare");
+  Check(mount("none", "/", nullptr, MS_REC | MS_PRIVATE, nullptr) == 0,
+        "making / private");
+
+  // /tmp might be mounted nosuid, the binary has to be setuid
+  Check(mount("suex-latency", root.c_str(), "tmpfs", 0, "mode=0755") == 0,
+        "mounting " + root);
+
+  std::string etc{root + "/etc"};
+  Check(system(("cp -a /etc " + etc).c_str()) == 0, "copying /etc");
+  WriteFile(etc + "/passwd",
+            opts.passwd.empty() ? FakePasswd() : ReadFile(opts.passwd));
+  WriteFile(etc + "/group",
+            opts.group.empty() ? FakeGroup() : ReadFile(opts.group));
+  WriteFile(etc + "/nsswitch.conf", "passwd: files\ngroup: files\n");
+  WriteFile(etc + "/pam.d/su",
+            "auth required pam_permit.so\n"
+            "account required pam_permit.so\n"
+            "session required pam_permit.so\n");
+  WriteFile(etc + "/suex.conf",
+            opts.config.empty() ? DefaultConfig(opts) : ReadFile(opts.config),
+            0440);
+  Check(chown((etc + "/suex.conf").c_str(), 0, 0) == 0, "chown suex.conf");
+  Check(system(("rm -rf " + etc + "/suex.conf.d").c_str()) == 0,
+        "removing suex.conf.d");
+
+  std::string binary{root + "/suex"};
+  WriteFile(binary, ReadFile(opts.binary), 0755);
+  Check(chown(binary.c_str(), 0, 0) == 0, "chown " + binary);
+  Check(chmod(binary.c_str(), 06755) == 0, "chmod " + binary);
+
+  Check(mount(etc.c_str(), "/etc", nullptr, MS_BIND, nullptr) == 0,
+        "mounting /etc");
+  // caches, auth tokens, snapshots & the audit log start empty, and stay
+  // private
+  for (const char *dir : {"/run", "/var/cache", "/var/log"}) {
+    Check(mount("suex-latency", dir, "tmpfs", 0, "mode=0755") == 0,
+          std::string{"mounting "} + dir);
+  }
+  return binary;
+}
+
+// runs suex once as the caller. returns its phases, in nanoseconds
+std::vector<std::pair<std::string, int64_t>> Invoke(const std::string &binary,
+                                                    const options_t &opts) {
+  int fds[2];
+  Check(pipe2(fds, O_CLOEXEC) == 0, "pipe");
+
+  std::vector<std::string> args{binary, "-u", opts.target};
+  args.insert(args.end(), opts.cmdargv.begin(), opts.cmdargv.end());
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.emplace_back(&arg[0]);
+  }
+  argv.emplace_back(nullptr);
+  char env_path[] = "PATH=/usr/bin:/bin";
+  char env_fd[] = "SUEX_TIMINGS_FD=3";
+  char *envp[] = {env_path, env_fd, nullptr};
+
+  int64_t begin{Now()};
+  pid_t pid = fork();
+  Check(pid >= 0, "fork");
+  if (pid == 0) {
+    // dup2 doesn't clear O_CLOEXEC if the descriptor is already 3
+    int null = open("/dev/null", O_WRONLY);
+    int fd = fds[1] == 3 ? fcntl(3, F_SETFD, 0) : dup2(fds[1], 3);
+    if (fd < 0 || dup2(null, STDOUT_FILENO) < 0 ||
+        setgroups(0, nullptr) != 0 || setgid(CALLER_ID) != 0 ||
+        setuid(CALLER_ID) != 0) {
+      _exit(127);
+    }
+    execve(argv[0], argv.data(), envp);
+    _exit(127);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    Check(errno == EINTR, "waitpid");
+  }
+  int64_t end{Now()};
+  close(fds[1]);
+
+  char buf[512];
+  ssize_t n = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || n <= 0) {
+    throw std::runtime_error(
+        "suex failed (status " + std::to_string(status) +
+        "), run it by hand: " + binary + " -u " + opts.target);
+  }
+  buf[n] = '\0';
+
+  // start=<ts> phase=<ns> ... end=<ts>. the time from fork() to main() and
+  // from the report to the exit of the command are derived from the
+  // timestamps, and so is the report itself.
+  std::vector<std::pair<std::string, int64_t>> phases;
+  std::istringstream ss{buf};
+  std::string pair;
+  int64_t marked{0};
+  while (ss >> pair) {
+    size_t eq = pair.find('=');
+    std::string name{pair.substr(0, eq)};
+    int64_t ns{std::stoll(pair.substr(eq + 1))};
+    if (name == "start") {
+      phases.emplace_back("startup", ns - begin);
+      marked = ns;
+    } else if (name == "end") {
+      phases.emplace_back("report", ns - marked);
+      phases.emplace_back("exec", end - ns);
+    } else {
+      phases.emplace_back(name, ns);
+      marked += ns;
+    }
+  }
+  phases.emplace_back("total", end - begin);
+  return phases;
+}
+
+void Record(const std::vector<std::pair<std::string, int64_t>> &phases,
+            samples_t *samples) {
+  for (const auto &phase : phases) {
+    auto it = std::find_if(samples->begin(), samples->end(),
+                           [&](const auto &s) { return s.first == phase.first; });
+    if (it == samples->end()) {
+      samples->emplace_back(phase.first, std::vector<int64_t>{});
+      it = samples->end() - 1;
+    }
+    it->second.emplace_back(phase.second);
+  }
+}
+
+double Percentile(std::vector<int64_t> v, double p) {
+  std::sort(v.begin(), v.end());
+  size_t idx = std::min(v.size() - 1, static_cast<size_t>(v.size() * p));
+  return v[idx] / 1000.0;
+}
+
+double Mean(const std::vector<int64_t> &v) {
+  double sum{0};
+  for (int64_t ns : v) {
+    sum += ns;
+  }
+  return sum / v.size() / 1000.0;
+}
+
+void Report(const samples_t &samples, const options_t &opts) {
+  if (opts.json) {
+    std::cout << "{\"iterations\": " << opts.iterations << ", \"phases\": {";
+    for (size_t i = 0; i < samples.size(); i++) {
+      const auto &s = samples[i];
+      std::cout << (i == 0 ? "" : ", ") << "\"" << s.first << "\": {"
+                << "\"p50_us\": " << Percentile(s.second, 0.5) << ", "
+                << "\"p99_us\": " << Percentile(s.second, 0.99) << ", "
+                << "\"mean_us\": " << Mean(s.second) << "}";
+    }
+    std::cout << "}}" << std::endl;
+    return;
+  }
+
+  std::printf("%-10s %12s %12s %12s\n", "phase", "p50 (us)", "p99 (us)",
+              "mean (us)");
+  for (const auto &s : samples) {
+    std::printf("%-10s %12.1f %12.1f %12.1f\n", s.first.c_str(),
+                Percentile(s.second, 0.5), Percentile(s.second, 0.99),
+                Mean(s.second));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  options_t opts{ParseOptions(argc, argv)};
+  if (geteuid() != 0) {
+    std::cerr << "suex_latency has to run as root, it mounts a private /etc"
+              << std::endl;
+    return 1;
+  }
+
+  char root[] = "/tmp/suex-latency-XXXXXX";
+  if (mkdtemp(root) == nullptr) {
+    std::cerr << "mkdtemp() failed: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  int rc{0};
+  try {
+    std::string binary{Isolate(root, opts)};
+    for (int i = 0; i < opts.warmup; i++) {
+      Invoke(binary, opts);
+    }
+
+    samples_t samples;
+    for (int i = 0; i < opts.iterations; i++) {
+      Record(Invoke(binary, opts), &samples);
+    }
+    Report(samples, opts);
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    rc = 1;
+  }
+
+  // the mounts are private, detaching them leaves nothing behind
+  for (const char *dir : {"/var/log", "/var/cache", "/run", "/etc"}) {
+    umount2(dir, MNT_DETACH);
+  }
+  umount2(root, MNT_DETACH);
+  rmdir(root);
+  return rc;
+}
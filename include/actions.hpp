@@ -13,6 +13,8 @@ void ClearAuthTokens(const permissions::Permissions &permissions);
 
 void ShowVersion();
 
+void ShowAuditLog(const optargs::OptArgs &opts);
+
 void ShowPermissions(const permissions::Permissions &permissions);
 
 void EditConfiguration(const optargs::OptArgs &opts,
@@ -20,9 +22,21 @@ void EditConfiguration(const optargs::OptArgs &opts,
 
 void CheckConfiguration(const optargs::OptArgs &opts);
 
+void RebuildIdentities(const permissions::Permissions &permissions);
+
 const permissions::Entity *Permit(const permissions::Permissions &permissions,
                                   const optargs::OptArgs &opts);
 
+// like Permit, for an entity that was already looked up (i.e by suexd)
+const permissions::Entity *Permit(const permissions::Entity *perm,
+                                  const std::string &auth_style,
+                                  const optargs::OptArgs &opts);
+
+// the environment of the command the entity permits: environ, with the
+// entity's setenv options applied. the variables are allocated into vec.
+char *const *GetEnv(std::vector<char *> *vec,
+                    const permissions::Entity &entity, char *environ[]);
+
 void SwitchUserAndExecute(const permissions::User &user,
                           const std::vector<char *> &cmdargv,
                           char *const envp[]);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <perm.hpp>
+#include <vector>
+
+#define PATH_VAR_LOG "/var/log"
+// append only, a record_t per invocation
+#define PATH_AUDIT_LOG PATH_VAR_LOG "/suex.audit"
+// "SXA1", in little endian
+#define AUDIT_MAGIC 0x31415853
+#define AUDIT_VERSION 2
+// the timings phases, and the whole invocation
+#define AUDIT_PHASES 6
+
+// the audit log keeps a fixed size binary record of every decision suex
+// made. a record is appended with a single write, so it costs microseconds
+// and concurrent invocations never interleave.
+namespace suex::audit {
+
+enum Decision : uint8_t { PERMIT, DENY, AUTH_FAILURE, BYPASS };
+
+// written as is, in the byte order of the host
+struct record_t {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t decision;
+  // the fragment of the matched rule (see Entity::Fragment), 0 if it's in
+  // the configuration itself. version 1 records leave it 0.
+  uint16_t fragment;
+  // CLOCK_REALTIME, in nanoseconds
+  int64_t time;
+  uint32_t pid;
+  uint32_t uid;
+  uint32_t as_uid;
+  // the line of the matched rule, 0 if none matched
+  int32_t rule;
+  // utils::Fingerprint of the command line
+  uint64_t command;
+  // in microseconds, by PhaseName
+  uint32_t latency[AUDIT_PHASES];
+};
+static_assert(sizeof(record_t) == 64, "audit records are 64 bytes");
+
+const char *PhaseName(size_t phase);
+
+const char *DecisionName(Decision decision);
+
+// fills the record of the invocation, and opens the log while suex is still
+// privileged. entity is the matched rule, if there's one.
+void Decide(Decision decision, const permissions::User &as_user,
+            const std::vector<char *> &cmdargv,
+            const permissions::Entity *entity);
+
+// appends the record to the log. denied invocations are committed when
+// they're denied, permitted ones right before the command is executed.
+void Commit();
+
+// decodes the log, shows the records of cmdargv (all of them if it's empty)
+// and a summary of their decisions & latencies.
+void Show(std::ostream &os, const std::vector<char *> &cmdargv);
+}  // namespace suex::audit
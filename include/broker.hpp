@@ -0,0 +1,65 @@
+#pragma once
+
+#include <auth.hpp>
+#include <conf.hpp>
+#include <cstdint>
+#include <memory>
+#include <perm.hpp>
+#include <vector>
+
+// suexd listens here. it has to be reachable by every user, permissions are
+// checked by the peer credentials of the connection. suex connects to it
+// only, it isn't up to the caller to pick another socket.
+#define PATH_BROKER_SOCKET PATH_VAR_RUN "/suexd.sock"
+// "SXB1", in little endian
+#define BROKER_MAGIC 0x31425853
+// longer commands are decided in process
+#define BROKER_MAX_COMMAND 32768
+// how long suex waits for suexd before deciding in process, in milliseconds.
+// suexd waits as long for a request.
+#define BROKER_TIMEOUT 1000
+// the clients suexd waits for at once, the oldest ones are dropped
+#define BROKER_MAX_CLIENTS 1024
+
+// suexd keeps the policy loaded, and decides whether callers are permitted
+// to execute commands, over a unix socket. suex asks it before loading the
+// policy, and falls back to loading it when suexd isn't running or can't
+// decide.
+namespace suex::broker {
+
+// the caller is never part of a request, it's taken from the connection
+struct request_t {
+  uint32_t magic;
+  uint32_t as_uid;
+  // followed by the command's arguments, each one terminated by a NUL
+};
+
+// UNDECIDED requests are decided in process
+enum Decision : uint8_t { PERMIT, DENY, NO_MATCH, UNDECIDED };
+
+enum Flags : uint8_t { NOPASS = 1, PERSIST = 2, KEEPENV = 4 };
+
+struct reply_t {
+  uint32_t magic;
+  Decision decision;
+  uint8_t flags;
+  // the fragment of the matched rule (see Entity::Fragment)
+  uint16_t fragment;
+  // the line of the matched rule, 0 if none matched
+  int32_t lineno;
+  // followed by the matched rule's command
+};
+
+// asks the suexd listening on path whether the running user is permitted to
+// execute cmdargv as as_user. returns false if it couldn't, and the policy
+// has to be loaded. otherwise, perm is the matched rule (nullptr if none
+// did), allocated in arena.
+bool Ask(const std::string &path, const permissions::User &as_user,
+         const std::vector<char *> &cmdargv, permissions::Arena *arena,
+         std::unique_ptr<permissions::Entity> *perm);
+
+// serves the requests of the clients that connect to listen_fd, until
+// watch_fd (an inotify descriptor) becomes readable.
+void Serve(const permissions::Permissions &permissions, int listen_fd,
+           int watch_fd);
+}  // namespace suex::broker
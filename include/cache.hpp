@@ -0,0 +1,112 @@
+#pragma once
+
+#include <grp.h>
+#include <pwd.h>
+#include <file.hpp>
+#include <memory>
+#include <rule.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace suex::permissions {
+
+#define PATH_VAR_CACHE "/var/cache"
+#define PATH_SUEX_CACHE PATH_VAR_CACHE "/suex"
+#define POLICY_CACHE_MAGIC "suexpol"
+#define POLICY_CACHE_VERSION 2
+#define PATH_IDENTITY_SNAPSHOT PATH_SUEX_CACHE "/identities"
+#define IDENTITY_SNAPSHOT_MAGIC "suexids"
+#define IDENTITY_SNAPSHOT_VERSION 2
+// seconds a snapshot is trusted for after it was built
+#define IDENTITY_SNAPSHOT_TTL 3600
+
+// A compiled form of a configuration file, stored under PATH_SUEX_CACHE.
+// It holds the tokenized rules, keyed by the file's device, inode, mtime,
+// ctime and size, so a hit doesn't read the file at all. Edits publish a new
+// inode (see File::Publish), and anything else that writes the file changes
+// its ctime. Users, groups, globs and environment variables are resolved
+// when the rules are loaded, so they never go stale.
+class PolicyCache {
+ public:
+  explicit PolicyCache(const file::File &conf);
+
+  // returns false if the cache is missing, stale, insecure or corrupted.
+  // the rules are views into the cache, and live as long as it does.
+  bool Read(std::vector<rule_t> *rules);
+
+  void Write(const std::vector<rule_t> &rules) const;
+
+  const std::string &Path() const { return path_; }
+
+  struct key_t {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    int64_t size;
+  };
+
+ private:
+  key_t key_{};
+  std::string path_;
+  std::unique_ptr<file::Mapping> mapping_{};
+};
+
+// A snapshot of the users & groups the system wide configuration names:
+// their ids, home directories, shells & members, stored under
+// PATH_SUEX_CACHE. NSS lookups consult it first, so running suex doesn't
+// depend on slow directory services (sssd, ldap, ...). The groups a user is
+// in aren't taken from it, they're always looked up.
+// It's only trusted while the configuration, its fragments, /etc/passwd and
+// /etc/group are unchanged, and for IDENTITY_SNAPSHOT_TTL seconds after it
+// was built.
+class IdentitySnapshot {
+ public:
+  // the current snapshot, mapped on first use.
+  // empty if it's missing, stale or insecure.
+  static const IdentitySnapshot &Current();
+
+  // looks up everything the configuration names, straight from NSS,
+  // and atomically replaces the current snapshot.
+  static void Build(const file::File &conf);
+
+  // the entries are views into the snapshot, nullptr if it doesn't hold them
+  const struct passwd *GetPasswd(const std::string &name) const;
+
+  const struct passwd *GetPasswd(uid_t uid) const;
+
+  const struct group *GetGroup(const std::string &name) const;
+
+  const struct group *GetGroup(gid_t gid) const;
+
+  size_t Users() const { return users_.size(); }
+
+  size_t Groups() const { return groups_.size(); }
+
+  // the state of the configuration file the snapshot was built for
+  struct generation_t {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+  };
+
+ private:
+  IdentitySnapshot() = default;
+
+  bool Load();
+
+  std::unique_ptr<file::Mapping> mapping_{};
+  std::vector<struct passwd> users_{};
+  std::vector<struct group> groups_{};
+  std::vector<std::vector<char *>> members_{};
+  std::unordered_map<std::string, size_t> user_names_{};
+  std::unordered_map<uid_t, size_t> uids_{};
+  std::unordered_map<std::string, size_t> group_names_{};
+  std::unordered_map<gid_t, size_t> gids_{};
+};
+}  // namespace suex::permissions
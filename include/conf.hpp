@@ -1,31 +1,155 @@
 #pragma once
 
-#include <re2/re2.h>
+#include <cache.hpp>
+#include <deque>
 #include <file.hpp>
+#include <map>
+#include <matcher.hpp>
+#include <memory>
+#include <mutex>
 #include <optarg.hpp>
 #include <perm.hpp>
+#include <rule.hpp>
 #include <string>
 #include <utils.hpp>
 
 namespace suex::permissions {
 
 #define MAX_FILE_SIZE (8192 * 1024)
+// rules are expanded by a pool of workers, in chunks of this size.
+// configurations that fit in one chunk are expanded serially.
+#define LOAD_CHUNK_SIZE 512
+// the matchers & resolved glob entities a Permissions keeps. they're built
+// for every caller, so the ones of long-lived processes (suexd, users of
+// libsuex) are bounded.
+#define MATCHER_CACHE_SIZE 1024
+#define RESOLVED_CACHE_SIZE 4096
+
+// FULL resolves and validates every rule in the configuration.
+// LAZY loads only what the running user might need, and defers whatever it
+// can to the permission lookup:
+//   * rules of other users & groups are skipped. they're only tokenized,
+//     so syntax errors are still caught.
+//   * glob commands (i.e /usr/bin/*) are matched against the executable
+//     instead of being expanded.
+//   * groups (i.e :wheel) are matched against the running user's groups
+//     instead of being expanded to their members.
+// SHARED is like LAZY, but loads the rules of every user, so permissions
+// can be looked up for any caller (i.e by suexd). the implicit rule of
+// privileged users applies to the members of wheel.
+enum LoadMode { FULL, LAZY, SHARED };
+
+// a map of at most capacity values, the oldest ones are dropped first.
+// values are shared, so dropping one doesn't free it while it's in use.
+// it isn't thread safe.
+template <typename Key, typename Value>
+class BoundedMap {
+ public:
+  explicit BoundedMap(size_t capacity) : capacity_{capacity} {}
+
+  // nullptr if there's no value for key
+  std::shared_ptr<const Value> Find(const Key &key) const {
+    auto it = values_.find(key);
+    return it == values_.end() ? nullptr : it->second;
+  }
+
+  // returns the value of key, which is value unless key already had one
+  std::shared_ptr<const Value> Insert(const Key &key,
+                                      std::shared_ptr<const Value> value) {
+    auto it = values_.find(key);
+    if (it != values_.end()) {
+      return it->second;
+    }
+    while (values_.size() >= capacity_) {
+      values_.erase(order_.front());
+      order_.pop_front();
+    }
+    order_.push_back(key);
+    return values_[key] = std::move(value);
+  }
+
+  void Clear() {
+    values_.clear();
+    order_.clear();
+  }
+
+  size_t Size() const { return values_.size(); }
+
+ private:
+  size_t capacity_;
+  std::map<Key, std::shared_ptr<const Value>> values_{};
+  // the keys, oldest first
+  std::deque<Key> order_{};
+};
 
-const RE2 &PermissionsOptionsRegex();
-const RE2 &PermissionLineRegex();
-const RE2 &CommentLineRegex();
-const RE2 &EmptyLineRegex();
+// the drop-in fragments of the system wide configuration, in the order they
+// are loaded (after it): regular *.conf files in PATH_CONFIG_DIR, by name.
+std::vector<std::string> ConfigFragments();
 
 class Permissions {
  private:
   typedef std::vector<Entity> Collection;
+  // (owner id, as user id) -> indices of the entities, in order
+  typedef std::unordered_map<uint64_t, std::vector<size_t>> Index;
 
   std::string auth_style_;
   std::vector<Entity> perms_{};
+  Index index_{};
+  // same as index_, for entities of groups. keyed by the group id.
+  Index group_index_{};
+  // (caller id, as user id) & the caller's groups -> matcher of the caller's
+  // entities, built on demand. the groups are part of the key, so a caller
+  // whose groups changed gets a matcher of its current groups.
+  mutable BoundedMap<std::pair<uint64_t, std::vector<gid_t>>, Matcher>
+      matchers_{MATCHER_CACHE_SIZE};
+  // glob entities that were resolved by Get, by the entity & the executable.
+  // each one owns its command (see Resolve), so dropping it frees it.
+  mutable BoundedMap<std::pair<const Entity *, std::string>, Entity>
+      resolved_{RESOLVED_CACHE_SIZE};
+  // guards matchers_ & resolved_, so loaded permissions can be looked up
+  // concurrently. it isn't held while a matcher is built.
+  mutable std::mutex cache_mutex_{};
+  // held while a matcher is built
+  mutable std::mutex build_mutex_{};
+  // owns the strings & environment options of the entities
+  std::unique_ptr<Arena> arena_{std::make_unique<Arena>()};
+  // the outcome of validating a single line
+  struct line_result_t {
+    std::vector<Entity> entities;
+    std::string error;
+  };
+  // line text -> its outcome, as of the last Revalidate
+  std::unordered_map<std::string, line_result_t> lines_{};
+  LoadMode mode_{FULL};
+  // the rules the last load read, including the ones it skipped
+  size_t rules_{0};
+  // why the last load failed
+  std::string error_{};
   file::File f_;
 
-  void Parse(const file::line_t &line,
-             std::function<void(const Entity &)> &&callback);
+  std::shared_ptr<const Matcher> GetMatcher(const User &caller,
+                                            const std::vector<gid_t> &groups,
+                                            const User &user) const;
+
+  // the glob entity e, expanded to exe. it's kept in resolved_.
+  std::shared_ptr<const Entity> Resolve(const Entity &e,
+                                        const std::string &exe) const;
+
+  void Add(const Entity &e);
+
+  void AddPrivileged();
+
+  void Reset();
+
+  void Clear();
+
+  void ReadRules(std::function<void(const std::vector<rule_t> &)> &&callback);
+
+  void Expand(const rule_t &rule,
+              std::function<void(const Entity &)> &&callback);
+
+  void ExpandAll(const std::vector<rule_t> &rules,
+                 std::function<void(const Entity &)> &&callback);
 
  public:
   typedef Collection::const_iterator const_iterator;
@@ -38,10 +162,15 @@ class Permissions {
 
   void operator=(const Permissions &) = delete;
 
-  Permissions &Load();
+  Permissions &Load(LoadMode mode = FULL);
 
   Permissions &Reload();
 
+  // like Reload, but only lines that changed since the last call are parsed
+  // and expanded again, the rest are taken from the previous call.
+  // unlike Load, every invalid line is reported, not just the first.
+  Permissions &Revalidate();
+
   explicit Permissions(const std::string &path, std::string auth_style);
 
   explicit Permissions(file::File &f, std::string auth_style);
@@ -49,15 +178,31 @@ class Permissions {
   std::string AuthStyle() const { return auth_style_; }
 
   static bool Privileged() {
-    return WheelGroup().Contains(RunningUser()) || RunningUser() == RootUser();
+    return RunningUserInGroup(WheelGroup().Id()) || RunningUser() == RootUser();
   }
 
+  // Get is thread safe, as long as the permissions aren't (re)loaded.
+  // the entity of a glob rule is resolved to the executable, and is valid
+  // until the thread's next Get; any other entity is valid until a reload.
   const Entity *Get(const User &user, const std::vector<char *> &cmdargv) const;
 
+  // like Get, for a caller other than the running user, which is in groups
+  const Entity *Get(const User &caller, const std::vector<gid_t> &groups,
+                    const User &user, const std::vector<char *> &cmdargv) const;
+
   unsigned long Size() const { return perms_.size(); };
 
+  // why the configuration is invalid, empty if it isn't.
+  // invalid configurations are loaded as empty ones.
+  const std::string &Error() const { return error_; };
+
   bool Empty() const { return perms_.empty(); };
 
+  // the number of rules in the configuration & its fragments, as of the last
+  // Load. unlike Size, it counts the rules LAZY loads skip, so it tells a
+  // configuration without rules from one without rules for the running user.
+  size_t Rules() const { return rules_; }
+
   const_iterator begin() const { return perms_.cbegin(); };
 
   const_iterator end() const { return perms_.cend(); };
@@ -1,21 +1,26 @@
 #pragma once
 #include <fcntl.h>
+#include <re2/stringpiece.h>
 #include <sys/stat.h>
 #include <exceptions.hpp>
 #include <gsl/gsl>
+#include <memory>
 #include <path.hpp>
 #include <string>
 
 namespace suex::file {
 
+// a view of a line in a mapped file, without the trailing newline
 struct line_t {
-  std::string txt;
+  re2::StringPiece txt;
   int lineno;
 };
 
 typedef struct stat stat_t;
 typedef struct flock flock_t;
 
+class Mapping;
+
 class File {
  public:
   explicit File(int fd);
@@ -51,6 +56,11 @@ class File {
 
   void Clone(File &other, mode_t mode) const;
 
+  // replaces path with a clone of this file, atomically: a new generation
+  // is written next to it, and renamed over it. readers of path never see a
+  // partially written file, so they don't need to lock it.
+  void Publish(const std::string &path, mode_t mode) const;
+
   off_t Seek(off_t offset, int whence) const;
 
   const std::string &Path() const;
@@ -65,7 +75,18 @@ class File {
 
   void Invalidate();
 
-  void ReadLine(std::function<void(const line_t &)> &&callback);
+  // the lines are views into a mapping of the file,
+  // and are valid only while the callback runs.
+  void ReadLine(std::function<void(const line_t &)> &&callback) const;
+
+  const stat_t Status() const;
+
+  Mapping Map() const;
+
+  // reads the whole file into memory, instead of mapping it. a mapping
+  // faults (SIGBUS) once the file is truncated under it, a copy can't, so
+  // files that might be written in place (i.e the configuration) are copied.
+  Mapping Copy() const;
 
   template <typename... Args>
   int Control(int cmd, Args &&... args) const {
@@ -77,10 +98,33 @@ class File {
   std::string path_{};
   std::string internal_path_{};
 
-  const stat_t Status() const;
   void Close();
 };
 
+// a read only memory mapping of a file, or a copy of it (see File::Copy)
+class Mapping {
+ public:
+  explicit Mapping(int fd, size_t size);
+  explicit Mapping(std::unique_ptr<char[]> copy, size_t size);
+  Mapping(const Mapping &) = delete;
+  Mapping(Mapping &&other) noexcept;
+  ~Mapping();
+  void operator=(const Mapping &) = delete;
+
+  gsl::span<const char> View() const {
+    return gsl::make_span(static_cast<const char *>(addr_), size_);
+  }
+
+  // the lines are views into the mapping, and are valid as long as it is
+  void ReadLine(std::function<void(const line_t &)> &&callback) const;
+
+ private:
+  void *addr_{nullptr};
+  size_t size_{0};
+  // set if it's a copy, addr_ points into it
+  std::unique_ptr<char[]> copy_{};
+};
+
 class Flock {
  public:
   explicit Flock(File &file, int16_t l_type, bool blocking = true);
@@ -90,6 +134,9 @@ class Flock {
   void operator=(const Flock &) = delete;
 
  private:
+  // a duplicate of the locked file's descriptor, so the lock is released even
+  // if the file was closed (or removed) before it. OFD locks belong to the
+  // open file description, which duplicates share.
   File f_;
 };
 
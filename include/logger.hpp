@@ -8,6 +8,14 @@
 
 using namespace suex;
 
+// streams into a logger only if it's verbose. when it isn't, nothing that's
+// streamed is evaluated, let alone formatted:
+//   LOG(debug) << "executing: " << utils::CommandArgsText(argv) << std::endl;
+#define LOG(level)                          \
+  if (!suex::logger::level().Verbose()) { \
+  } else                                    \
+    suex::logger::level()
+
 namespace suex::logger {
 
 enum Type { DEBUG, INFO, WARNING, ERROR };
@@ -17,6 +25,8 @@ class Logger {
   static Logger &get(Type type);
   void VerboseOn() { verbose_ = true; }
 
+  bool Verbose() const { return verbose_; }
+
   ~Logger() = default;
 
   std::ostream &operator<<(const char *text);
@@ -25,7 +35,8 @@ class Logger {
 
  private:
   std::ostream &Stream() {
-    static std::ofstream devnull{PATH_DEV_NULL};
+    // streams aren't thread safe, std::clog is the exception
+    static thread_local std::ofstream devnull{PATH_DEV_NULL};
 
     if (verbose_) {
       return std::clog;
@@ -36,7 +47,6 @@ class Logger {
   explicit Logger(Type type);
   Logger(const Logger &other);
   Type type_;
-  permissions::User user_{};
   bool verbose_{false};
 };
 
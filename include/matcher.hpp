@@ -0,0 +1,51 @@
+#pragma once
+
+#include <re2/re2.h>
+#include <re2/set.h>
+#include <functional>
+#include <perm.hpp>
+#include <string>
+#include <vector>
+
+namespace suex::permissions {
+
+// DFA memory budget of a single matcher. large policies have thousands of
+// patterns per user, which don't fit in RE2's default budget.
+#define MATCHER_MAX_MEM (64 << 20)
+
+// Matches a command against a list of entities in a single pass over the
+// command text, by compiling all of their cmd_re into one RE2::Set.
+// glob entities can't be compiled, and are handed to a callback instead.
+class Matcher {
+ public:
+  typedef std::function<bool(const Entity &)> GlobMatcher;
+
+  explicit Matcher(std::vector<const Entity *> entities);
+
+  Matcher(const Matcher &) = delete;
+
+  void operator=(const Matcher &) = delete;
+
+  // returns the last entity that matches cmd (like the original suex).
+  // glob entities that come after the last matching entity are
+  // matched by glob_matcher, from the last one backwards.
+  const Entity *Match(const std::string &cmd,
+                      const GlobMatcher &glob_matcher) const;
+
+  unsigned long Size() const { return entities_.size(); };
+
+ private:
+  std::vector<const Entity *> entities_;
+  // set pattern index -> entity index. patterns that fail to compile
+  // are not added.
+  std::vector<long> patterns_{};
+  // indices of the glob entities
+  std::vector<long> globs_{};
+  re2::RE2::Set set_;
+  bool compiled_{false};
+
+  long MatchSet(const std::string &cmd) const;
+
+  long MatchEach(const std::string &cmd) const;
+};
+}  // namespace suex::permissions
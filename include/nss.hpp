@@ -0,0 +1,41 @@
+#pragma once
+
+#include <grp.h>
+#include <pwd.h>
+#include <string>
+#include <vector>
+
+namespace suex::nss {
+
+// Memoized NSS lookups, shared by the whole process.
+// Every name or id is queried at most once, including the ones that don't
+// exist, and the returned entries stay valid until the process exits
+// (unlike the ones returned by getpwnam & co).
+// Only the name, id, group, home directory and shell (or members) are kept.
+//
+// The identity snapshot (see cache.hpp) is consulted before NSS, except for
+// the groups a user is in.
+
+const struct passwd *GetPasswd(const std::string &name);
+
+const struct passwd *GetPasswd(uid_t uid);
+
+const struct group *GetGroup(const std::string &name);
+
+const struct group *GetGroup(gid_t gid);
+
+// the groups a user is in, as getgrouplist returns them
+const std::vector<gid_t> &GetGroupList(const std::string &user, gid_t gid);
+
+// Memoizing for the lifetime of the process suits suex, but not processes
+// that outlive the identities they looked up (suexd, users of libsuex): a
+// user removed from a group would keep the rules of the group. Once it's
+// called, every lookup goes to NSS (and its own caches, i.e sssd & nscd),
+// without the identity snapshot, and an entry (or a group list) is valid
+// only until the thread's next lookup of the same database.
+void TurnOffMemoization();
+
+// calls getgrouplist, without memoization
+std::vector<gid_t> QueryGroupList(const std::string &user, gid_t gid);
+
+}  // namespace suex::nss
@@ -8,6 +8,8 @@
 
 namespace suex::optargs {
 #define PATH_CONFIG "/etc/suex.conf"
+// drop-in fragments of PATH_CONFIG
+#define PATH_CONFIG_DIR PATH_CONFIG ".d"
 #define DEFAULT_AUTH_STYLE "su"
 
 class OptArgs {
@@ -32,6 +34,10 @@ class OptArgs {
 
   bool ListPermissions() const { return list_; }
 
+  bool RebuildIdentities() const { return rebuild_identities_; }
+
+  bool ShowAudit() const { return show_audit_; }
+
   const permissions::User &AsUser() const { return user_; }
 
  private:
@@ -46,6 +52,8 @@ class OptArgs {
   bool show_version_{false};
   bool edit_config_{false};
   bool list_{false};
+  bool rebuild_identities_{false};
+  bool show_audit_{false};
   bool interactive_{true};
   bool clear_{false};
   bool verbose_mode_{false};
@@ -3,10 +3,17 @@
 #include <grp.h>
 #include <pwd.h>
 #include <re2/re2.h>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 namespace suex::permissions {
 
@@ -60,14 +67,16 @@ class Group {
   std::string name_;
   int gid_{-1};
   std::set<User> members_;
-  void Initialize(const struct group *gr);
+  void Initialize(const struct group *gr, bool resolve_members);
 
  public:
   typedef Collection::const_iterator const_iterator;
 
-  explicit Group(gid_t gid);
+  explicit Group(gid_t gid, bool resolve_members = true);
 
-  explicit Group(const std::string &grp);
+  // resolving the members looks up every one of them,
+  // which is expensive for big groups.
+  explicit Group(const std::string &grp, bool resolve_members = true);
 
   Group(const Group &grp);
 
@@ -83,7 +92,7 @@ class Group {
 
   int Id() const { return gid_; };
 
-  bool Exists() { return gid_ != -1; }
+  bool Exists() const { return gid_ != -1; }
 
   bool operator==(const Group &other) const;
 
@@ -98,40 +107,47 @@ class Group {
   bool operator>=(const Group &other) const;
 };
 
+class Arena;
+
+// A single permission, expanded from a configuration line.
+// Entities are kept compact: users & groups are kept by id, and strings and
+// environment options are owned by the Arena of the configuration they were
+// loaded from, which has to outlive them.
 class Entity {
  public:
   typedef std::set<std::string> EnvToRemove;
   typedef std::unordered_map<std::string, std::string> EnvToAdd;
 
-  explicit Entity(const User &user, const User &as_user, bool deny,
-                  bool keepenv, bool nopass, bool persist, EnvToAdd env_to_add,
-                  EnvToRemove env_to_remove, const std::string &cmd_re)
-      : user_{user},
-        as_user_{as_user},
-        deny_{deny},
-        nopass_{nopass},
-        keepenv_{keepenv},
-        persist_{persist},
-        cmd_re{cmd_re},
-        env_to_add_{std::move(env_to_add)},
-        env_to_remove{std::move(env_to_remove)} {}
-
-  explicit Entity(const User &user, const User &as_user, bool deny,
-                  bool keepenv, bool nopass, bool persist,
-                  const std::string &cmd_re)
-      : user_{user},
-        as_user_{as_user},
-        deny_{deny},
-        nopass_{nopass},
-        keepenv_{keepenv},
-        persist_{persist},
-        cmd_re{cmd_re},
-        env_to_add_{},
-        env_to_remove{} {}
-
-  const User &Owner() const { return user_; };
-
-  const User &AsUser() const { return as_user_; };
+  // the 'setenv { ... }' option, shared by all the entities of a line
+  struct Env {
+    EnvToAdd add;
+    EnvToRemove remove;
+  };
+
+  explicit Entity(Arena *arena, const User &user, const User &as_user,
+                  bool deny, bool keepenv, bool nopass, bool persist,
+                  const Env *env, int lineno, const std::string &cmd_re,
+                  const std::string &cmd_glob = "");
+
+  // entities of groups (i.e :wheel) can be kept unexpanded.
+  // they're matched against the groups of the running user.
+  explicit Entity(Arena *arena, const Group &group, const User &as_user,
+                  bool deny, bool keepenv, bool nopass, bool persist,
+                  const Env *env, int lineno, const std::string &cmd_re,
+                  const std::string &cmd_glob = "");
+
+  int OwnerId() const { return owner_id_; };
+
+  // the user's name, or the group's name for entities of groups
+  const std::string &OwnerName() const { return *owner_name_; };
+
+  bool IsGroup() const { return group_id_ != -1; }
+
+  int GroupId() const { return group_id_; }
+
+  int AsUserId() const { return as_id_; };
+
+  const std::string &AsUserName() const { return *as_name_; };
 
   bool PromptForPassword() const { return !nopass_; };
 
@@ -139,37 +155,97 @@ class Entity {
 
   bool KeepEnvironment() const { return keepenv_; };
 
-  bool EnvironmentVariablesConfigured() const {
-    return !(env_to_add_.empty() && env_to_remove.empty());
-  }
+  bool EnvironmentVariablesConfigured() const { return env_ != nullptr; }
 
   bool ShouldAddEnvVar(const std::string &env) const {
-    return env_to_add_.find(env) != env_to_add_.end();
+    return env_ != nullptr && env_->add.find(env) != env_->add.end();
   }
 
-  const EnvToAdd EnvVarsToAdd() const { return env_to_add_; }
+  const EnvToAdd &EnvVarsToAdd() const;
 
   bool ShouldRemoveEnvVar(const std::string &env) const {
-    return env_to_remove.find(env) != env_to_remove.end();
+    return env_ != nullptr && env_->remove.find(env) != env_->remove.end();
   }
 
   bool Deny() const { return deny_; };
 
+  // the line of the rule the entity was expanded from, 0 if it wasn't
+  int LineNumber() const { return static_cast<int>(lineno_); };
+
+  // for entities of a line that moved (see Permissions::Revalidate)
+  void SetLineNumber(int lineno) { lineno_ = static_cast<unsigned>(lineno); }
+
+  // the fragment of the rule the entity was expanded from (see
+  // rule_t::fragment_index), 0 if it's the configuration itself
+  int Fragment() const { return fragment_; }
+
+  void SetFragment(int fragment) {
+    fragment_ = static_cast<uint16_t>(std::min(fragment, UINT16_MAX));
+  }
+
   bool CanExecute(const User &user, const std::string &cmd) const;
 
-  const std::string &Command() const { return cmd_re; };
+  const std::string &Command() const { return *cmd_re_; };
+
+  // compiled lazily, and shared between all entities with the same cmd_re.
+  // it's thread safe.
+  const re2::RE2 &CommandRegex() const;
+
+  // entities of glob commands (i.e /usr/bin/*) can be kept unexpanded.
+  // their cmd_re starts with the glob instead of an executable.
+  bool IsGlob() const { return cmd_glob_ != nullptr; }
+
+  const std::string &CommandGlob() const { return *cmd_glob_; };
+
+  // the cmd_re of a glob entity, with the glob replaced by the executable
+  std::string ResolveCommand(const std::string &exe) const;
+
+  // returns a copy of a glob entity, expanded to the given executable
+  Entity Resolve(Arena *arena, const std::string &exe) const;
 
  private:
-  User user_;
-  User as_user_;
-  bool deny_{true};
-  bool nopass_{false};
-  bool keepenv_{false};
-  bool persist_{false};
-  std::string cmd_re;
-  EnvToAdd env_to_add_;
-  EnvToRemove env_to_remove;
+  int owner_id_{-1};
+  int group_id_{-1};
+  int as_id_{-1};
+  bool deny_ : 1;
+  bool nopass_ : 1;
+  bool keepenv_ : 1;
+  bool persist_ : 1;
+  // fits in the padding after the flags
+  unsigned lineno_ : 24;
+  uint16_t fragment_{0};
+  const std::string *owner_name_{nullptr};
+  const std::string *as_name_{nullptr};
+  const std::string *cmd_re_{nullptr};
+  const std::string *cmd_glob_{nullptr};
+  const Env *env_{nullptr};
+  mutable std::shared_ptr<const re2::RE2> cmd_rx_{};
 };
+
+// Owns the strings & environment options of the entities of a single load.
+// Strings are interned, so the names, commands and globs that repeat across
+// entities (i.e when a line expands to many users or executables) are only
+// stored once. It's thread safe, rules are expanded in parallel.
+class Arena {
+ public:
+  const std::string *Intern(const std::string &str);
+
+  const Entity::Env *Add(Entity::Env env);
+
+  void Clear();
+
+ private:
+  std::mutex mutex_;
+  // nodes never move, so pointers to the strings stay valid
+  std::unordered_set<std::string> strings_{};
+  std::deque<Entity::Env> envs_{};
+};
+
+// compiles cmd_re, or returns the regex that's already compiled for it.
+// it's thread safe.
+std::shared_ptr<const re2::RE2> Compile(const std::string &cmd_re);
+
+std::vector<gid_t> GetGroups(const User &user);
 void Set(const User &user);
 std::ostream &operator<<(std::ostream &os, const Entity &entity);
 }  // namespace suex::permissions
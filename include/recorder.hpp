@@ -0,0 +1,71 @@
+#pragma once
+
+#include <auth.hpp>
+#include <cstdint>
+
+// the number of events the flight recorder keeps, older ones are overwritten
+#define RECORDER_EVENTS 512
+// the recorder is dumped here (with a slot number appended) when suex crashes
+#define PATH_RECORDER_DUMP PATH_SUEX_TMP "/recorder."
+// the number of dumps that are kept. once they're all taken, suex doesn't
+// dump again until root removes them.
+#define RECORDER_DUMPS 8
+
+// the flight recorder keeps the last events of the invocation in a fixed
+// ring, so a slow or failed invocation can be diagnosed after the fact,
+// without running it verbosely again.
+//
+// it's off until it's enabled, which suex & suexd do. libsuex doesn't, so
+// the commands its callers check aren't recorded. recording doesn't
+// allocate, and the ring is locked only while an event is copied into it.
+namespace suex::recorder {
+
+// turns on recording, for the rest of the process
+void Enable();
+
+enum Type : uint8_t { PHASE, RULE, NSS, PAM, ERROR };
+
+// CLOCK_MONOTONIC, in nanoseconds
+int64_t Now();
+
+// records an event that took duration nanoseconds, and ended now.
+// what & detail are copied, and truncated if they're too long.
+void Record(Type type, const char *what, const char *detail = "",
+            int64_t value = 0, int64_t duration = 0);
+
+// records an event when it goes out of scope, with how long it took.
+// what & detail have to outlive it.
+class Span {
+ public:
+  Span(Type type, const char *what, const char *detail = "")
+      : type_{type}, what_{what}, detail_{detail} {}
+  Span(const Span &) = delete;
+  ~Span() { Record(type_, what_, detail_, value_, Now() - start_); }
+  void operator=(const Span &) = delete;
+
+  void Value(int64_t value) { value_ = value; }
+
+ private:
+  Type type_;
+  const char *what_;
+  const char *detail_;
+  int64_t value_{0};
+  int64_t start_{Now()};
+};
+
+// writes the events to fd, oldest first. it's async signal safe, so it's
+// safe to call from a signal handler (where it doesn't wait for the lock for
+// long, the thread that holds it might be the one that crashed).
+void Dump(int fd);
+
+// dumps the events to the first free PATH_RECORDER_DUMP<slot>, which only
+// root can read. existing dumps are never overwritten. returns false if it
+// couldn't, i.e all RECORDER_DUMPS slots are taken.
+bool DumpToFile();
+
+// dumps the events to a file when suex crashes (SIGSEGV, SIGBUS, SIGFPE,
+// SIGILL & SIGABRT), and then calls the handlers that were installed before
+// (i.e the stack trace). signals the caller can send or provoke at will
+// (i.e SIGQUIT, SIGXFSZ) aren't handled.
+void HandleSignals();
+}  // namespace suex::recorder
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <re2/stringpiece.h>
+#include <string>
+
+namespace suex::permissions {
+
+// a permission line, as written in the configuration file.
+// users, groups, globs & environment variables are not resolved yet.
+//
+// the strings are views into the buffer the rule was tokenized from.
+struct rule_t {
+  int lineno;
+  bool deny;
+  bool nopass;
+  bool keepenv;
+  bool persist;
+  re2::StringPiece user;
+  re2::StringPiece as;
+  re2::StringPiece cmd;
+  re2::StringPiece args;
+  // the 'setenv { ... }' option, if set
+  re2::StringPiece env;
+  // the fragment the rule was read from, nullptr if it's from the
+  // configuration itself. its line numbers are the fragment's.
+  const char *fragment;
+  // the position of the fragment in ConfigFragments, from 1.
+  // 0 if the rule is from the configuration itself.
+  int fragment_index;
+};
+
+// tokenizes a configuration line in a single pass, without allocating.
+// returns false for comments & empty lines, throws if the line is invalid.
+//
+// the grammar is:
+//   (permit|deny) [options] [:]user as user cmd command [args args]
+bool Tokenize(re2::StringPiece line, int lineno, rule_t *rule);
+}  // namespace suex::permissions
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <conf.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace suex::permissions {
+
+// a loaded policy. it's never modified once it's published, and it's kept
+// alive by the readers that still use it.
+typedef std::shared_ptr<const Permissions> Snapshot;
+
+// Publishes generations of a policy to concurrent readers (RCU-style).
+// A generation is loaded in full before it's swapped in, so readers never
+// see a partially loaded policy, and never wait for a load to finish.
+class Snapshots {
+ public:
+  explicit Snapshots(std::string path, std::string auth_style,
+                     LoadMode mode = SHARED);
+
+  Snapshots(const Snapshots &) = delete;
+
+  void operator=(const Snapshots &) = delete;
+
+  // the latest generation
+  Snapshot Current() const { return std::atomic_load(&current_); }
+
+  // incremented whenever a generation is published
+  uint64_t Generation() const {
+    return generation_.load(std::memory_order_acquire);
+  }
+
+  // loads the policy again, and publishes it. an invalid policy isn't
+  // published, the previous generation is kept and an error is thrown.
+  // concurrent reloads are serialized.
+  Snapshot Reload();
+
+  // Follows the generations of a Snapshots, for a single thread.
+  // Get costs an atomic load while the generation doesn't change, readers
+  // don't even touch the reference count of the snapshot they share.
+  class Reader {
+   public:
+    explicit Reader(const Snapshots &snapshots) : snapshots_(snapshots) {}
+
+    const Permissions &Get() {
+      uint64_t generation{snapshots_.Generation()};
+      if (snapshot_ == nullptr || generation != generation_) {
+        snapshot_ = snapshots_.Current();
+        generation_ = generation;
+      }
+      return *snapshot_;
+    }
+
+   private:
+    const Snapshots &snapshots_;
+    Snapshot snapshot_{};
+    uint64_t generation_{0};
+  };
+
+ private:
+  std::string path_;
+  std::string auth_style_;
+  LoadMode mode_;
+  // accessed with std::atomic_load & std::atomic_store only
+  Snapshot current_{};
+  std::atomic<uint64_t> generation_{0};
+  std::mutex reload_mutex_{};
+};
+}  // namespace suex::permissions
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* libsuex decides whether suex permits a user to execute a command as another
+ * user, without executing suex. the API is stable, and is the only one the
+ * shared library exports a promise for. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a loaded policy. it can be checked from several threads at once. */
+typedef struct suex_policy suex_policy_t;
+
+typedef enum {
+  SUEX_PERMIT,
+  SUEX_DENY,
+  /* no rule matched, which suex denies */
+  SUEX_NO_MATCH,
+  /* the policy isn't checked for root, or for executing as yourself */
+  SUEX_BYPASS,
+} suex_decision_t;
+
+typedef struct {
+  suex_decision_t decision;
+  /* the line of the matched rule, 0 if none matched or it isn't in the
+   * policy (i.e the wheel group's) */
+  int lineno;
+  /* the options of the matched rule */
+  int nopass;
+  int persist;
+  int keepenv;
+  int setenv;
+  /* the command of the matched rule, NULL if none matched. it's valid until
+   * the policy is freed, or until the thread's next check if the rule's
+   * command is a glob. */
+  const char *command;
+} suex_result_t;
+
+/* loads a policy, as suex.conf(5) describes it. an invalid policy fails to
+ * load. returns NULL on failure, see suex_error.
+ *
+ * the users & groups the policy names are looked up when it's loaded, so
+ * load it again when they change. nothing else is cached: every check looks
+ * up its users, and the groups the caller is in, straight from NSS (and its
+ * own caches, i.e sssd & nscd), so a user removed from a group isn't
+ * permitted its rules by the next check. */
+suex_policy_t *suex_policy_load(const char *path);
+
+/* like suex_policy_load, from the len bytes of buf */
+suex_policy_t *suex_policy_load_buffer(const char *buf, size_t len);
+
+/* decides whether uid is permitted to execute argv as as_uid. argv is NULL
+ * terminated, and argv[0] has to be the absolute path suex would resolve.
+ * returns 0, or -1 on failure, see suex_error. */
+int suex_policy_check(suex_policy_t *policy, uid_t uid, uid_t as_uid,
+                      const char *const argv[], suex_result_t *result);
+
+void suex_policy_free(suex_policy_t *policy);
+
+/* why the last call that failed in this thread did */
+const char *suex_error(void);
+
+const char *suex_version(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <recorder.hpp>
+
+// the phase timings of an invocation. they're recorded in the flight recorder
+// & the audit log, and reported to the latency harness only by builds with
+// SUEX_PHASE_TIMINGS (suex_harness).
+#define TIMINGS_FD_ENV "SUEX_TIMINGS_FD"
+
+namespace suex::timings {
+// marks the end of a phase, which started at the previous mark
+void Mark(const char *phase);
+
+// how long the phase took, in nanoseconds. 0 if it wasn't marked.
+int64_t Duration(const char *phase);
+
+// nanoseconds since the process started
+int64_t Elapsed();
+
+#ifdef SUEX_PHASE_TIMINGS
+// writes the phases to the descriptor in TIMINGS_FD_ENV, if it's set, as a
+// single line of 'phase=nanoseconds' pairs. 'start' & 'end' are absolute
+// CLOCK_MONOTONIC timestamps, so the time it took to get to main() and to
+// exec the command can be derived from them.
+void Report();
+#else
+inline void Report() {}
+#endif
+}  // namespace suex::timings
@@ -13,6 +13,9 @@
 const suex::permissions::User &RunningUser();
 const suex::permissions::User &RootUser();
 const suex::permissions::Group &WheelGroup();
+// looked up once, with a single getgrouplist call
+const std::vector<gid_t> &RunningUserGroups();
+bool RunningUserInGroup(int gid);
 
 #define CONCAT_(a, b) a##b
 #define CONCAT(a, b) CONCAT_(a, b)
@@ -20,6 +23,10 @@ const suex::permissions::Group &WheelGroup();
 
 namespace suex::utils {
 std::string CommandArgsText(const std::vector<char *> &cmdargv);
+
+// 64 bit FNV-1a hash. stable across runs, unlike std::hash.
+uint64_t Fingerprint(gsl::span<const char> data);
+
 template <typename T>
 inline T *ConstCorrect(T const *ptr) {
   return const_cast<T *>(ptr);
@@ -27,6 +34,10 @@ inline T *ConstCorrect(T const *ptr) {
 
 bool BypassPermissions(const suex::permissions::User &as_user);
 
+// like BypassPermissions, for a caller other than the running user
+bool BypassPermissions(const suex::permissions::User &caller,
+                       const suex::permissions::User &as_user);
+
 bool AskQuestion(const std::string &prompt);
 
 std::string GetEditor();
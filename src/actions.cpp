@@ -1,8 +1,11 @@
 #include <wait.h>
 #include <actions.hpp>
+#include <audit.hpp>
 #include <auth.hpp>
 #include <logger.hpp>
+#include <recorder.hpp>
 #include <sstream>
+#include <timings.hpp>
 #include <version.hpp>
 
 using suex::optargs::OptArgs;
@@ -13,7 +16,7 @@ using suex::permissions::User;
 
 void suex::ShowPermissions(const permissions::Permissions &permissions) {
   for (const permissions::Entity &e : permissions) {
-    if (e.Owner().Id() != RunningUser().Id() && !permissions.Privileged()) {
+    if (e.OwnerId() != RunningUser().Id() && !permissions.Privileged()) {
       continue;
     }
 
@@ -23,9 +26,16 @@ void suex::ShowPermissions(const permissions::Permissions &permissions) {
 
 const permissions::Entity *suex::Permit(const Permissions &permissions,
                                         const OptArgs &opts) {
-  auto perm = permissions.Get(opts.AsUser(), opts.CommandArguments());
+  return Permit(permissions.Get(opts.AsUser(), opts.CommandArguments()),
+                permissions.AuthStyle(), opts);
+}
+
+const permissions::Entity *suex::Permit(const permissions::Entity *perm,
+                                        const std::string &auth_style,
+                                        const OptArgs &opts) {
   if (perm == nullptr || perm->Deny()) {
-    std::ostringstream ss;
+    audit::Decide(audit::DENY, opts.AsUser(), opts.CommandArguments(), perm);
+    audit::Commit();
     throw suex::PermissionError(
         "You are not allowed to execute '%s' as %s",
         utils::CommandArgsText(opts.CommandArguments()).c_str(),
@@ -34,14 +44,47 @@ const permissions::Entity *suex::Permit(const Permissions &permissions,
 
   if (perm->PromptForPassword()) {
     std::string cache_token{perm->CacheAuth() ? perm->Command() : ""};
-    if (!auth::Authenticate(permissions.AuthStyle(), opts.Interactive(),
-                            cache_token)) {
+    if (!auth::Authenticate(auth_style, opts.Interactive(), cache_token)) {
+      audit::Decide(audit::AUTH_FAILURE, opts.AsUser(),
+                    opts.CommandArguments(), perm);
+      audit::Commit();
       throw suex::PermissionError("Incorrect password");
     }
   }
+  audit::Decide(audit::PERMIT, opts.AsUser(), opts.CommandArguments(), perm);
   return perm;
 }
 
+char *const *suex::GetEnv(std::vector<char *> *vec,
+                          const permissions::Entity &entity,
+                          char *environ[]) {
+  if (!entity.EnvironmentVariablesConfigured()) {
+    return environ;
+  }
+
+  for (int i = 0; environ[i] != nullptr; i++) {
+    auto ev = env::SplitRaw(environ[i]);
+
+    if (entity.ShouldRemoveEnvVar(ev.first)) {
+      continue;
+    }
+
+    if (entity.ShouldAddEnvVar(ev.first)) {
+      continue;
+    }
+
+    vec->emplace_back(env::ToRaw(ev.first, ev.second));
+  }
+
+  for (const auto &ev : entity.EnvVarsToAdd()) {
+    vec->emplace_back(env::ToRaw(ev.first, ev.second));
+  }
+
+  vec->emplace_back(nullptr);
+
+  return vec->data();
+}
+
 void suex::SwitchUserAndExecute(const User &user,
                                 const std::vector<char *> &cmdargv,
                                 char *const envp[]) {
@@ -50,13 +93,18 @@ void suex::SwitchUserAndExecute(const User &user,
 
   // set permissions to requested id and gid
   permissions::Set(user);
+  timings::Mark("switch");
 
   // execute with uid and gid. path lookup is done internally, so execvp is not
   // needed.
 
-  logger::debug() << "executing: " << utils::CommandArgsText(cmdargv)
-                  << std::endl;
+  LOG(debug) << "executing: " << utils::CommandArgsText(cmdargv) << std::endl;
 
+  timings::Report();
+  audit::Commit();
+  if (logger::debug().Verbose()) {
+    recorder::Dump(STDERR_FILENO);
+  }
   execvpe(*cmdargv.data(), &(*cmdargv.data()), envp);
 }
 
@@ -76,7 +124,15 @@ void suex::ClearAuthTokens(const Permissions &permissions) {
   if (cleared < 0) {
     throw std::runtime_error("error while clearing tokens");
   }
-  logger::info() << "cleared " << cleared << " tokens" << std::endl;
+  LOG(info) << "cleared " << cleared << " tokens" << std::endl;
+}
+
+void suex::ShowAuditLog(const OptArgs &opts) {
+  if (!Permissions::Privileged()) {
+    throw suex::PermissionError(
+        "Access denied. You are not allowed to view the audit log.");
+  }
+  audit::Show(std::cout, opts.CommandArguments());
 }
 
 void suex::ShowVersion() { std::cout << "suex: " << VERSION << std::endl; }
@@ -97,7 +153,7 @@ void suex::EditConfiguration(const OptArgs &opts,
   // defer removing the lock file after lock is successful
   DEFER({ edit_f.Remove(); });
 
-  file::File conf_f(PATH_CONFIG, O_RDWR);
+  file::File conf_f(PATH_CONFIG, O_RDONLY);
   file::File tmp_f(PATH_TMP, O_TMPFILE | O_RDWR | O_EXCL, S_IRUSR | S_IRGRP);
 
   conf_f.Clone(tmp_f, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
@@ -129,7 +185,8 @@ void suex::EditConfiguration(const OptArgs &opts,
       throw std::runtime_error("error while waiting for $EDITOR");
     }
 
-    if (perms.Reload().Size() > 0) {
+    // only the lines that were edited are validated again
+    if (perms.Revalidate().Size() > 0) {
       break;
     }
 
@@ -141,9 +198,31 @@ void suex::EditConfiguration(const OptArgs &opts,
     }
   }
 
-  file::Flock conf_lock{conf_f, F_WRLCK};
-  tmp_f.Clone(conf_f, S_IRUSR | S_IRGRP);
+  // readers that opened the previous generation keep reading it
+  tmp_f.Publish(conf_f.Path(), S_IRUSR | S_IRGRP);
   std::cout << PATH_CONFIG << " changes applied." << std::endl;
+
+  // the old snapshot is stale now, lookups fall back to NSS until it's
+  // rebuilt. it's keyed by the generation that was published (a new inode),
+  // so it's built from that one, not from tmp_f.
+  try {
+    file::File published{PATH_CONFIG, O_RDONLY | O_NOFOLLOW | O_CLOEXEC};
+    permissions::IdentitySnapshot::Build(published);
+  } catch (suex::IOError &e) {
+    LOG(warning) << "couldn't build identity snapshot: " << e.what()
+                 << std::endl;
+  }
+}
+
+void suex::RebuildIdentities(const Permissions &permissions) {
+  if (!permissions.Privileged()) {
+    throw suex::PermissionError(
+        "Access denied. You are not allowed to rebuild the identity snapshot");
+  }
+
+  file::File conf_f{PATH_CONFIG, O_RDONLY};
+  permissions::IdentitySnapshot::Build(conf_f);
+  std::cout << PATH_IDENTITY_SNAPSHOT << " rebuilt." << std::endl;
 }
 
 void suex::CheckConfiguration(const OptArgs &opts) {
@@ -0,0 +1,179 @@
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <audit.hpp>
+#include <cstring>
+#include <file.hpp>
+#include <iomanip>
+#include <logger.hpp>
+#include <sstream>
+#include <timings.hpp>
+
+using suex::audit::Decision;
+using suex::audit::record_t;
+
+record_t audit_record{};
+int audit_fd{-1};
+
+const char *suex::audit::PhaseName(size_t phase) {
+  static const char *names[AUDIT_PHASES]{"options", "load",   "permit",
+                                         "env",     "switch", "total"};
+  return phase < AUDIT_PHASES ? names[phase] : "?";
+}
+
+const char *suex::audit::DecisionName(Decision decision) {
+  switch (decision) {
+    case PERMIT:
+      return "permit";
+    case DENY:
+      return "deny";
+    case AUTH_FAILURE:
+      return "auth-failure";
+    case BYPASS:
+      return "bypass";
+  }
+  return "?";
+}
+
+void suex::audit::Decide(Decision decision, const permissions::User &as_user,
+                         const std::vector<char *> &cmdargv,
+                         const permissions::Entity *entity) {
+  timespec ts{0, 0};
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  std::string cmdtxt{utils::CommandArgsText(cmdargv)};
+  audit_record.magic = AUDIT_MAGIC;
+  audit_record.version = AUDIT_VERSION;
+  audit_record.decision = decision;
+  audit_record.time =
+      static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  audit_record.pid = static_cast<uint32_t>(getpid());
+  audit_record.uid = static_cast<uint32_t>(RunningUser().Id());
+  audit_record.as_uid = static_cast<uint32_t>(as_user.Id());
+  audit_record.fragment =
+      entity == nullptr ? 0 : static_cast<uint16_t>(entity->Fragment());
+  audit_record.rule = entity == nullptr ? 0 : entity->LineNumber();
+  audit_record.command = utils::Fingerprint(cmdtxt);
+
+  if (audit_fd >= 0) {
+    return;
+  }
+  audit_fd = open(PATH_AUDIT_LOG,
+                  O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR);
+  if (audit_fd < 0) {
+    // auditing doesn't get in the way of executing the command
+    LOG(warning) << "can't open '" PATH_AUDIT_LOG "': " << std::strerror(errno)
+                 << std::endl;
+  }
+}
+
+void suex::audit::Commit() {
+  if (audit_fd < 0) {
+    return;
+  }
+  DEFER({
+    close(audit_fd);
+    audit_fd = -1;
+  });
+
+  for (size_t i = 0; i < AUDIT_PHASES - 1; i++) {
+    audit_record.latency[i] =
+        static_cast<uint32_t>(timings::Duration(PhaseName(i)) / 1000);
+  }
+  audit_record.latency[AUDIT_PHASES - 1] =
+      static_cast<uint32_t>(timings::Elapsed() / 1000);
+
+  // O_APPEND writes of a single record are atomic, no need for a lock
+  if (write(audit_fd, &audit_record, sizeof(audit_record)) !=
+      sizeof(audit_record)) {
+    LOG(warning) << "can't append to '" PATH_AUDIT_LOG "': "
+                 << std::strerror(errno) << std::endl;
+  }
+}
+
+// microseconds, as milliseconds
+std::string Millis(uint32_t us) {
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3) << us / 1000.0 << "ms";
+  return ss.str();
+}
+
+void suex::audit::Show(std::ostream &os, const std::vector<char *> &cmdargv) {
+  bool filtered{!cmdargv.empty()};
+  uint64_t command{filtered ? utils::Fingerprint(utils::CommandArgsText(cmdargv))
+                            : 0};
+
+  file::File f{PATH_AUDIT_LOG, O_RDONLY | O_NOFOLLOW};
+  auto mapping = f.Map();
+  auto view = mapping.View();
+
+  size_t decisions[BYPASS + 1]{0}, corrupt{0};
+  std::vector<uint32_t> latencies[AUDIT_PHASES];
+  auto size = static_cast<size_t>(view.size());
+  for (size_t pos = 0; pos + sizeof(record_t) <= size;
+       pos += sizeof(record_t)) {
+    record_t r{};
+    std::memcpy(&r, view.data() + pos, sizeof(r));
+    if (r.magic != AUDIT_MAGIC || r.version < 1 ||
+        r.version > AUDIT_VERSION || r.decision > BYPASS) {
+      corrupt++;
+      continue;
+    }
+
+    if (filtered && r.command != command) {
+      continue;
+    }
+
+    time_t secs{static_cast<time_t>(r.time / 1000000000)};
+    tm local{};
+    localtime_r(&secs, &local);
+    os << std::put_time(&local, "%F %T") << " pid " << r.pid << " uid "
+       << r.uid << " as " << r.as_uid << " "
+       << DecisionName(static_cast<Decision>(r.decision)) << " line "
+       << r.rule;
+    if (r.fragment != 0) {
+      os << " of fragment " << r.fragment;
+    }
+    os << " cmd " << std::hex << std::setw(16) << std::setfill('0')
+       << r.command << std::dec << std::setfill(' ') << " "
+       << Millis(r.latency[AUDIT_PHASES - 1]) << std::endl;
+
+    decisions[r.decision]++;
+    for (size_t i = 0; i < AUDIT_PHASES; i++) {
+      latencies[i].emplace_back(r.latency[i]);
+    }
+  }
+
+  os << std::endl << "records: " << latencies[0].size();
+  for (uint8_t d = PERMIT; d <= BYPASS; d++) {
+    os << ", " << DecisionName(static_cast<Decision>(d)) << ": "
+       << decisions[d];
+  }
+  if (corrupt > 0) {
+    os << ", corrupt: " << corrupt;
+  }
+  os << std::endl;
+
+  if (latencies[0].empty()) {
+    return;
+  }
+
+  os << std::left << std::setw(10) << "phase" << std::setw(12) << "mean"
+     << std::setw(12) << "p50" << std::setw(12) << "p99"
+     << "max" << std::endl;
+  for (size_t i = 0; i < AUDIT_PHASES; i++) {
+    auto &lat = latencies[i];
+    std::sort(lat.begin(), lat.end());
+    uint64_t sum{0};
+    for (uint32_t us : lat) {
+      sum += us;
+    }
+    os << std::setw(10) << PhaseName(i) << std::setw(12)
+       << Millis(static_cast<uint32_t>(sum / lat.size())) << std::setw(12)
+       << Millis(lat[lat.size() / 2]) << std::setw(12)
+       << Millis(lat[lat.size() * 99 / 100]) << Millis(lat.back())
+       << std::endl;
+  }
+  os << std::right;
+}
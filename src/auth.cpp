@@ -2,6 +2,7 @@
 #include <auth.hpp>
 #include <conf.hpp>
 #include <logger.hpp>
+#include <recorder.hpp>
 
 #include <security/pam_misc.h>
 #include <sstream>
@@ -54,23 +55,23 @@ time_t GetToken(const std::string &filename) {
     throw suex::IOError("auth timestamp '%s' is too big", filename.c_str());
   }
 
-  char buff[f.Size()];
-  auto buff_view = gsl::make_span(static_cast<char *>(buff), f.Size());
-  ssize_t bytes = f.Read(buff_view);
-
+  // the timestamp is the first line of the token. it's rewritten in place
+  // (O_TRUNC) by other sessions, so it's read, a mapping would fault.
   time_t ts{0};
-  if (bytes > 0) {
-    std::istringstream ss(buff_view.data());
-    ss >> ts;
-  }
+  f.Copy().ReadLine([&](const file::line_t &line) {
+    if (line.lineno == 1) {
+      std::istringstream ss(line.txt.ToString());
+      ss >> ts;
+    }
+  });
 
   return ts;
 }
 
 int PamConversation(int num_msg, const struct pam_message **msg,
                     struct pam_response **resp, void *appdata) {
-  logger::debug() << "pam converstaion msg " << num_msg << ": " << (*msg)->msg
-                  << std::endl;
+  LOG(debug) << "pam converstaion msg " << num_msg << ": " << (*msg)->msg
+             << std::endl;
   const auto auth_data = static_cast<struct auth_data *>(appdata);
   if (!auth_data->prompt) {
     return PAM_AUTH_ERR;
@@ -89,14 +90,14 @@ int auth::ClearTokens(const std::string &style) {
   std::string glob_pattern{
       Sprintf("%s/%s*", PATH_SUEX_TMP, GetTokenPrefix(style).c_str())};
   if (glob(glob_pattern.c_str(), 0, nullptr, &globbuf) != 0) {
-    logger::debug() << "glob returned nothing" << std::endl;
+    LOG(debug) << "glob returned nothing" << std::endl;
     return 0;
   }
 
   DEFER(globfree(&globbuf));
   auto paths = gsl::make_span(globbuf.gl_pathv, globbuf.gl_pathc);
   for (std::string token_path : paths) {
-    logger::debug() << "clearing: " << token_path << std::endl;
+    LOG(debug) << "clearing: " << token_path << std::endl;
     if (!file::File(token_path, O_RDONLY).Remove(true)) {
       return -1;
     }
@@ -111,10 +112,9 @@ bool auth::StyleExists(const std::string &style) {
 
 bool auth::Authenticate(const std::string &style, bool prompt,
                         const std::string &cache_token) {
-  logger::debug() << "Authenticating | "
-                  << "auth style: " << style << " | "
-                  << "cache: " << (cache_token.empty() ? "off" : "on") << " | "
-                  << "prompt: " << (prompt ? "on" : "off") << std::endl;
+  LOG(debug) << "Authenticating | " << "auth style: " << style << " | "
+             << "cache: " << (cache_token.empty() ? "off" : "on") << " | "
+             << "prompt: " << (prompt ? "on" : "off") << std::endl;
 
   if (!StyleExists(style)) {
     throw suex::AuthError("Invalid PAM policy: policy '%s' doesn't exist",
@@ -129,7 +129,7 @@ bool auth::Authenticate(const std::string &style, bool prompt,
     time_t now{time(nullptr)};
 
     if (ts < 0 || now < ts) {
-      logger::warning() << "invalid auth timestamp: " << ts << std::endl;
+      LOG(warning) << "invalid auth timestamp: " << ts << std::endl;
       file::File(ts_filename, O_RDONLY).Remove(false);
       return false;
     }
@@ -145,38 +145,49 @@ bool auth::Authenticate(const std::string &style, bool prompt,
   const struct pam_conv pam_conversation = {PamConversation, &data};
   pam_handle_t *handle = nullptr;  // this gets set by pam_start
 
-  int retval = pam_start(style.c_str(), RunningUser().Name().c_str(),
-                         &pam_conversation, &handle);
+  int retval;
+  {
+    recorder::Span span{recorder::PAM, "pam_start", style.c_str()};
+    retval = pam_start(style.c_str(), RunningUser().Name().c_str(),
+                       &pam_conversation, &handle);
+    span.Value(retval);
+  }
 
   if (retval != PAM_SUCCESS) {
-    logger::debug() << "[pam]: pam_start returned: " << retval << std::endl;
+    LOG(debug) << "[pam]: pam_start returned: " << retval << std::endl;
     return false;
   }
 
   DEFER({
     retval = pam_end(handle, retval);
     if (retval != PAM_SUCCESS) {
-      logger::debug() << "[pam]: pam_end returned " << retval << std::endl;
+      LOG(debug) << "[pam]: pam_end returned " << retval << std::endl;
     }
   });
 
-  retval = pam_authenticate(handle, 0);
+  {
+    recorder::Span span{recorder::PAM, "pam_authenticate", style.c_str()};
+    retval = pam_authenticate(handle, 0);
+    span.Value(retval);
+  }
   if (retval != PAM_SUCCESS) {
-    logger::debug() << "[pam]: pam_authenticate returned " << retval
-                    << std::endl;
+    LOG(debug) << "[pam]: pam_authenticate returned " << retval << std::endl;
     return false;
   }
 
-  retval = pam_acct_mgmt(handle, 0);
+  {
+    recorder::Span span{recorder::PAM, "pam_acct_mgmt", style.c_str()};
+    retval = pam_acct_mgmt(handle, 0);
+    span.Value(retval);
+  }
   if (retval != PAM_SUCCESS) {
-    logger::debug() << "[pam]: pam_acct_mgmt returned " << retval << std::endl;
+    LOG(debug) << "[pam]: pam_acct_mgmt returned " << retval << std::endl;
     return false;
   }
 
   retval = pam_close_session(handle, 0);
   if (retval != PAM_SUCCESS) {
-    logger::debug() << "[pam]: pam_close_session returned " << retval
-                    << std::endl;
+    LOG(debug) << "[pam]: pam_close_session returned " << retval << std::endl;
     return false;
   }
   // set the timestamp file
@@ -0,0 +1,272 @@
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <auth.hpp>
+#include <broker.hpp>
+#include <cstring>
+#include <deque>
+#include <logger.hpp>
+#include <recorder.hpp>
+
+using suex::broker::reply_t;
+using suex::broker::request_t;
+using suex::permissions::Entity;
+using suex::permissions::Permissions;
+using suex::permissions::User;
+
+// a stuck peer can't hold the other side for longer than BROKER_TIMEOUT
+void SetTimeout(int fd) {
+  timeval tv{BROKER_TIMEOUT / 1000, (BROKER_TIMEOUT % 1000) * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool PeerCredentials(int fd, ucred *cred) {
+  socklen_t len{sizeof(*cred)};
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, cred, &len) == 0;
+}
+
+bool suex::broker::Ask(const std::string &path, const User &as_user,
+                       const std::vector<char *> &cmdargv,
+                       permissions::Arena *arena,
+                       std::unique_ptr<permissions::Entity> *perm) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+  if (fd < 0) {
+    return false;
+  }
+  DEFER(close(fd));
+  SetTimeout(fd);
+
+  // suexd knows the caller by the credentials it connected with, which
+  // have to be the running user's, not the ones suex is setuid to
+  int64_t start{recorder::Now()};
+  if (seteuid(getuid()) < 0) {
+    return false;
+  }
+  int rc{connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))};
+  int error{errno};
+  if (seteuid(0) < 0) {
+    throw suex::IOError("couldn't restore the effective uid: %s",
+                        std::strerror(errno));
+  }
+  if (rc < 0) {
+    LOG(debug) << "suexd isn't listening on " << path << ": "
+               << std::strerror(error) << std::endl;
+    return false;
+  }
+
+  // anyone can listen on a socket, only root is trusted to decide
+  ucred cred{};
+  if (!PeerCredentials(fd, &cred) || cred.uid != 0) {
+    LOG(warning) << "ignoring " << path << ", it's not served by root"
+                 << std::endl;
+    return false;
+  }
+
+  request_t req{BROKER_MAGIC, static_cast<uint32_t>(as_user.Id())};
+  std::string msg{reinterpret_cast<const char *>(&req), sizeof(req)};
+  for (const char *arg : cmdargv) {
+    if (arg == nullptr) {
+      break;
+    }
+    msg.append(arg).push_back('\0');
+  }
+  if (msg.size() > sizeof(req) + BROKER_MAX_COMMAND ||
+      send(fd, msg.data(), msg.size(), MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(msg.size())) {
+    return false;
+  }
+
+  std::vector<char> buf(sizeof(reply_t) + BROKER_MAX_COMMAND);
+  ssize_t len{recv(fd, buf.data(), buf.size(), 0)};
+  reply_t reply{};
+  if (len < static_cast<ssize_t>(sizeof(reply))) {
+    return false;
+  }
+  std::memcpy(&reply, buf.data(), sizeof(reply));
+  if (reply.magic != BROKER_MAGIC || reply.decision >= UNDECIDED) {
+    return false;
+  }
+
+  // 1 if it's permitted, 0 if it's denied & -1 if no rule matched
+  std::string cmd_re{buf.data() + sizeof(reply), len - sizeof(reply)};
+  int64_t value{reply.decision == PERMIT ? 1
+                                         : reply.decision == DENY ? 0 : -1};
+  recorder::Record(recorder::RULE, "suexd", cmd_re.c_str(), value,
+                   recorder::Now() - start);
+  LOG(debug) << "suexd decided line " << reply.lineno << " of fragment "
+             << reply.fragment << std::endl;
+
+  perm->reset();
+  if (reply.decision != NO_MATCH) {
+    *perm = std::make_unique<Entity>(
+        arena, RunningUser(), as_user, reply.decision == DENY,
+        (reply.flags & KEEPENV) != 0, (reply.flags & NOPASS) != 0,
+        (reply.flags & PERSIST) != 0, nullptr, reply.lineno, cmd_re);
+    (*perm)->SetFragment(reply.fragment);
+  }
+  return true;
+}
+
+const char *DecisionName(suex::broker::Decision decision) {
+  switch (decision) {
+    case suex::broker::PERMIT:
+      return "permit";
+    case suex::broker::DENY:
+      return "deny";
+    case suex::broker::NO_MATCH:
+      return "no match";
+    case suex::broker::UNDECIDED:
+      return "undecided";
+  }
+  return "?";
+}
+
+// a client of Serve, which is dropped if it doesn't send its request by the
+// deadline (see recorder::Now)
+struct client_t {
+  int fd;
+  int64_t deadline;
+};
+
+// decides the request of the client connected to fd
+void Decide(const Permissions &permissions, int fd, std::vector<char> *buf) {
+  reply_t reply{BROKER_MAGIC, suex::broker::UNDECIDED, 0, 0, 0};
+  std::string cmd_re;
+  ucred cred{};
+  if (!PeerCredentials(fd, &cred)) {
+    LOG(warning) << "couldn't get the peer of fd " << fd << ": "
+                 << std::strerror(errno) << std::endl;
+    return;
+  }
+  ssize_t len{recv(fd, buf->data(), buf->size(), 0)};
+
+  try {
+    request_t req{};
+    if (len <= static_cast<ssize_t>(sizeof(req)) ||
+        static_cast<size_t>(len) == buf->size() ||
+        (*buf)[static_cast<size_t>(len) - 1] != '\0') {
+      throw suex::IOError("malformed request of uid %d", cred.uid);
+    }
+    std::memcpy(&req, buf->data(), sizeof(req));
+    if (req.magic != BROKER_MAGIC) {
+      throw suex::IOError("malformed request of uid %d", cred.uid);
+    }
+
+    // the arguments point into buf
+    std::vector<char *> cmdargv;
+    for (char *arg = buf->data() + sizeof(req); arg < buf->data() + len;
+         arg += std::strlen(arg) + 1) {
+      cmdargv.emplace_back(arg);
+    }
+    cmdargv.emplace_back(nullptr);
+
+    // an invalid configuration is reported by suex
+    User caller{cred.uid};
+    User as_user{static_cast<uid_t>(req.as_uid)};
+    if (caller.Exists() && as_user.Exists() && !permissions.Empty()) {
+      const Entity *perm{permissions.Get(
+          caller, suex::permissions::GetGroups(caller), as_user, cmdargv)};
+      if (perm == nullptr) {
+        reply.decision = suex::broker::NO_MATCH;
+      } else if (perm->Deny() || !perm->EnvironmentVariablesConfigured()) {
+        // setenv options are evaluated in the environment of suex
+        reply.decision =
+            perm->Deny() ? suex::broker::DENY : suex::broker::PERMIT;
+        reply.flags = (perm->PromptForPassword() ? 0 : suex::broker::NOPASS) |
+                      (perm->CacheAuth() ? suex::broker::PERSIST : 0) |
+                      (perm->KeepEnvironment() ? suex::broker::KEEPENV : 0);
+        reply.fragment = static_cast<uint16_t>(perm->Fragment());
+        reply.lineno = perm->LineNumber();
+        cmd_re = perm->Command();
+      }
+    }
+  } catch (std::exception &e) {
+    recorder::Record(recorder::ERROR, e.what());
+    LOG(warning) << e.what() << std::endl;
+  }
+
+  LOG(info) << "uid " << cred.uid << " (pid " << cred.pid
+            << "): " << DecisionName(reply.decision) << ", line "
+            << reply.lineno << std::endl;
+  std::string msg{reinterpret_cast<const char *>(&reply), sizeof(reply)};
+  msg.append(cmd_re);
+  if (send(fd, msg.data(), msg.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+    LOG(warning) << "couldn't reply to uid " << cred.uid << ": "
+                 << std::strerror(errno) << std::endl;
+  }
+}
+
+void suex::broker::Serve(const Permissions &permissions, int listen_fd,
+                         int watch_fd) {
+  // one byte more than a request can be, so longer ones are detected
+  std::vector<char> buf(sizeof(request_t) + BROKER_MAX_COMMAND + 1);
+  // the clients that connected, and didn't send their request yet. they're
+  // waited for together, so a client that doesn't send anything doesn't
+  // hold the others back.
+  std::deque<client_t> clients;
+  DEFER(for (const client_t &client : clients) close(client.fd));
+  std::vector<pollfd> fds;
+  while (true) {
+    // the oldest ones are dropped, and so are the ones that timed out
+    int64_t now{recorder::Now()};
+    while (!clients.empty() && (clients.size() > BROKER_MAX_CLIENTS ||
+                                clients.front().deadline <= now)) {
+      LOG(warning) << "dropping a client that didn't send its request"
+                   << std::endl;
+      close(clients.front().fd);
+      clients.pop_front();
+    }
+
+    fds.assign({{listen_fd, POLLIN, 0}, {watch_fd, POLLIN, 0}});
+    for (const client_t &client : clients) {
+      fds.push_back({client.fd, POLLIN, 0});
+    }
+    int timeout{clients.empty()
+                    ? -1
+                    : static_cast<int>(
+                          (clients.front().deadline - now) / 1000000 + 1)};
+    if (poll(fds.data(), fds.size(), timeout) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw suex::IOError("poll failed: %s", std::strerror(errno));
+    }
+
+    if (fds[1].revents != 0) {
+      return;
+    }
+
+    // the clients that sent their request (or hung up) are decided, in the
+    // order they connected
+    std::deque<client_t> waiting;
+    for (size_t i = 0; i < clients.size(); i++) {
+      if (fds[i + 2].revents == 0) {
+        waiting.push_back(clients[i]);
+        continue;
+      }
+      DEFER(close(clients[i].fd));
+      Decide(permissions, clients[i].fd, &buf);
+    }
+    clients.swap(waiting);
+
+    if (fds[0].revents == 0) {
+      continue;
+    }
+
+    int fd{accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)};
+    if (fd < 0) {
+      LOG(warning) << "accept failed: " << std::strerror(errno) << std::endl;
+      continue;
+    }
+    clients.push_back({fd, recorder::Now() + BROKER_TIMEOUT * 1000000L});
+  }
+}
@@ -0,0 +1,552 @@
+#include <cache.hpp>
+#include <conf.hpp>
+#include <logger.hpp>
+#include <nss.hpp>
+#include <set>
+
+using suex::permissions::IdentitySnapshot;
+using suex::permissions::PolicyCache;
+using suex::permissions::rule_t;
+
+#define PATH_PASSWD "/etc/passwd"
+#define PATH_GROUP "/etc/group"
+
+struct header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  PolicyCache::key_t key;
+};
+
+struct snapshot_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t users;
+  uint32_t groups;
+  int64_t created;
+  IdentitySnapshot::generation_t generation;
+  // see Sources
+  uint64_t sources;
+};
+
+enum RuleFlags : uint8_t {
+  DENY = 1 << 0,
+  NOPASS = 1 << 1,
+  KEEPENV = 1 << 2,
+  PERSIST = 1 << 3,
+};
+
+bool operator==(const PolicyCache::key_t &a, const PolicyCache::key_t &b) {
+  return a.dev == b.dev && a.ino == b.ino && a.mtime_sec == b.mtime_sec &&
+         a.mtime_nsec == b.mtime_nsec && a.ctime_sec == b.ctime_sec &&
+         a.ctime_nsec == b.ctime_nsec && a.size == b.size;
+}
+
+bool operator==(const IdentitySnapshot::generation_t &a,
+                const IdentitySnapshot::generation_t &b) {
+  return a.dev == b.dev && a.ino == b.ino && a.mtime_sec == b.mtime_sec &&
+         a.mtime_nsec == b.mtime_nsec && a.size == b.size;
+}
+
+IdentitySnapshot::generation_t Generation(const file::stat_t &st) {
+  IdentitySnapshot::generation_t gen{};
+  gen.dev = st.st_dev;
+  gen.ino = st.st_ino;
+  gen.mtime_sec = st.st_mtim.tv_sec;
+  gen.mtime_nsec = st.st_mtim.tv_nsec;
+  gen.size = st.st_size;
+  return gen;
+}
+
+template <typename T>
+void Append(std::string *buff, const T &val) {
+  buff->append(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+void Append(std::string *buff, const re2::StringPiece &str) {
+  Append(buff, static_cast<uint32_t>(str.size()));
+  buff->append(str.data(), str.size());
+}
+
+// appends a string with its NUL terminator,
+// so it can be used straight from the mapping
+void AppendCString(std::string *buff, const char *str) {
+  Append(buff, re2::StringPiece(str, std::strlen(str) + 1));
+}
+
+// reads values out of a mapped cache, fails when it's truncated
+class Reader {
+ public:
+  explicit Reader(gsl::span<const char> buff) : buff_{buff} {}
+
+  template <typename T>
+  bool Take(T *val) {
+    if (buff_.size() - pos_ < static_cast<ptrdiff_t>(sizeof(T))) {
+      return false;
+    }
+    std::memcpy(val, buff_.data() + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  bool Take(re2::StringPiece *str) {
+    uint32_t size{0};
+    if (!Take(&size) || buff_.size() - pos_ < size) {
+      return false;
+    }
+    *str = re2::StringPiece(buff_.data() + pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  bool Take(const char **str) {
+    re2::StringPiece sp;
+    if (!Take(&sp) || sp.empty() || sp[sp.size() - 1] != '\0') {
+      return false;
+    }
+    *str = sp.data();
+    return true;
+  }
+
+  bool Done() const { return pos_ == buff_.size(); }
+
+ private:
+  gsl::span<const char> buff_;
+  ptrdiff_t pos_{0};
+};
+
+bool SecureDirectory() {
+  file::stat_t st{0};
+  if (stat(PATH_SUEX_CACHE, &st) != 0) {
+    if (geteuid() != 0 || mkdir(PATH_SUEX_CACHE, S_IRWXU) < 0) {
+      return false;
+    }
+    return SecureDirectory();
+  }
+
+  // nobody but root should be able to plant a cache
+  return S_ISDIR(st.st_mode) && st.st_uid == 0 &&
+         (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+PolicyCache::PolicyCache(const file::File &conf)
+    : path_{Sprintf("%s/%016llx.policy", PATH_SUEX_CACHE,
+                    static_cast<unsigned long long>(utils::Fingerprint(
+                        gsl::make_span(conf.Path().c_str(),
+                                       conf.Path().size()))))} {
+  const file::stat_t st = conf.Status();
+  key_.dev = st.st_dev;
+  key_.ino = st.st_ino;
+  key_.mtime_sec = st.st_mtim.tv_sec;
+  key_.mtime_nsec = st.st_mtim.tv_nsec;
+  key_.ctime_sec = st.st_ctim.tv_sec;
+  key_.ctime_nsec = st.st_ctim.tv_nsec;
+  key_.size = st.st_size;
+}
+
+bool PolicyCache::Read(std::vector<rule_t> *rules) {
+  if (!path::Exists(path_) || !SecureDirectory()) {
+    return false;
+  }
+
+  try {
+    file::File f{path_, O_RDONLY | O_NOFOLLOW | O_CLOEXEC};
+    if (!S_ISREG(f.Mode()) || !f.IsSecure()) {
+      LOG(warning) << "policy cache '" << path_ << "' is not secure"
+                   << std::endl;
+      return false;
+    }
+
+    auto mapping = std::make_unique<file::Mapping>(f.Map());
+    Reader reader{mapping->View()};
+
+    header_t header{};
+    if (!reader.Take(&header) ||
+        std::strncmp(header.magic, POLICY_CACHE_MAGIC, sizeof(header.magic)) !=
+            0 ||
+        header.version != POLICY_CACHE_VERSION || !(header.key == key_)) {
+      LOG(debug) << "policy cache '" << path_ << "' is stale" << std::endl;
+      return false;
+    }
+
+    // every rule takes more than a byte, don't trust the header blindly
+    if (header.count > static_cast<uint64_t>(mapping->View().size())) {
+      LOG(warning) << "policy cache '" << path_ << "' is corrupted"
+                   << std::endl;
+      return false;
+    }
+
+    std::vector<rule_t> cached(header.count);
+    for (rule_t &rule : cached) {
+      int32_t lineno{0};
+      uint8_t flags{0};
+      if (!reader.Take(&lineno) || !reader.Take(&flags) ||
+          !reader.Take(&rule.user) || !reader.Take(&rule.as) ||
+          !reader.Take(&rule.cmd) || !reader.Take(&rule.args) ||
+          !reader.Take(&rule.env)) {
+        LOG(warning) << "policy cache '" << path_ << "' is corrupted"
+                     << std::endl;
+        return false;
+      }
+      rule.lineno = lineno;
+      rule.deny = (flags & DENY) != 0;
+      rule.nopass = (flags & NOPASS) != 0;
+      rule.keepenv = (flags & KEEPENV) != 0;
+      rule.persist = (flags & PERSIST) != 0;
+    }
+
+    if (!reader.Done()) {
+      LOG(warning) << "policy cache '" << path_ << "' is corrupted"
+                   << std::endl;
+      return false;
+    }
+
+    *rules = std::move(cached);
+    mapping_ = std::move(mapping);
+  } catch (suex::IOError &e) {
+    LOG(warning) << "couldn't read policy cache: " << e.what() << std::endl;
+    return false;
+  }
+
+  LOG(debug) << "loaded " << rules->size() << " rules from '" << path_ << "'"
+             << std::endl;
+  return true;
+}
+
+void PolicyCache::Write(const std::vector<rule_t> &rules) const {
+  if (geteuid() != 0 || !SecureDirectory()) {
+    return;
+  }
+
+  header_t header{};
+  std::strncpy(header.magic, POLICY_CACHE_MAGIC, sizeof(header.magic));
+  header.version = POLICY_CACHE_VERSION;
+  header.count = static_cast<uint32_t>(rules.size());
+  header.key = key_;
+
+  std::string buff;
+  Append(&buff, header);
+  for (const rule_t &rule : rules) {
+    uint8_t flags = (rule.deny ? DENY : 0) | (rule.nopass ? NOPASS : 0) |
+                    (rule.keepenv ? KEEPENV : 0) |
+                    (rule.persist ? PERSIST : 0);
+    Append(&buff, static_cast<int32_t>(rule.lineno));
+    Append(&buff, flags);
+    Append(&buff, rule.user);
+    Append(&buff, rule.as);
+    Append(&buff, rule.cmd);
+    Append(&buff, rule.args);
+    Append(&buff, rule.env);
+  }
+
+  // write a new cache and atomically replace the old one,
+  // so readers never see a partially written cache.
+  std::string tmp_path{Sprintf("%s.%d", path_.c_str(), getpid())};
+  try {
+    file::File f{tmp_path,
+                 O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW | O_CLOEXEC,
+                 S_IRUSR | S_IRGRP};
+    if (f.Write(gsl::make_span(buff.data(), buff.size())) !=
+        static_cast<ssize_t>(buff.size())) {
+      throw suex::IOError("short write to '%s'", tmp_path.c_str());
+    }
+    if (rename(tmp_path.c_str(), path_.c_str()) < 0) {
+      throw suex::IOError("rename('%s') failed: %s", tmp_path.c_str(),
+                          std::strerror(errno));
+    }
+  } catch (suex::IOError &e) {
+    unlink(tmp_path.c_str());
+    LOG(warning) << "couldn't write policy cache: " << e.what() << std::endl;
+    return;
+  }
+
+  LOG(debug) << "cached " << rules.size() << " rules in '" << path_ << "'"
+             << std::endl;
+}
+
+// the users & groups, and the fragments that name them, change without the
+// configuration changing. this fingerprints their state, which the snapshot
+// is built for as well.
+uint64_t Sources() {
+  std::vector<std::string> paths{PATH_PASSWD, PATH_GROUP, PATH_CONFIG_DIR};
+  for (const std::string &path : suex::permissions::ConfigFragments()) {
+    paths.emplace_back(path);
+  }
+
+  std::string buff;
+  for (const std::string &path : paths) {
+    // missing files are fingerprinted as zeros
+    file::stat_t st{0};
+    IdentitySnapshot::generation_t gen{};
+    if (stat(path.c_str(), &st) == 0) {
+      gen = Generation(st);
+    }
+    buff.append(path).push_back('\0');
+    Append(&buff, gen);
+  }
+  return utils::Fingerprint(gsl::make_span(buff.data(), buff.size()));
+}
+
+const IdentitySnapshot &IdentitySnapshot::Current() {
+  static IdentitySnapshot snapshot{[] {
+    IdentitySnapshot s;
+    if (!s.Load()) {
+      s = IdentitySnapshot();
+    }
+    return s;
+  }()};
+  return snapshot;
+}
+
+bool IdentitySnapshot::Load() {
+  file::stat_t conf_st{0};
+  if (!path::Exists(PATH_IDENTITY_SNAPSHOT) || !SecureDirectory() ||
+      stat(PATH_CONFIG, &conf_st) != 0) {
+    return false;
+  }
+
+  try {
+    file::File f{PATH_IDENTITY_SNAPSHOT, O_RDONLY | O_NOFOLLOW | O_CLOEXEC};
+    if (!S_ISREG(f.Mode()) || !f.IsSecure()) {
+      LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                   << "' is not secure" << std::endl;
+      return false;
+    }
+
+    mapping_ = std::make_unique<file::Mapping>(f.Map());
+    Reader reader{mapping_->View()};
+
+    snapshot_header_t header{};
+    if (!reader.Take(&header) ||
+        std::strncmp(header.magic, IDENTITY_SNAPSHOT_MAGIC,
+                     sizeof(header.magic)) != 0 ||
+        header.version != IDENTITY_SNAPSHOT_VERSION ||
+        !(header.generation == Generation(conf_st)) ||
+        header.sources != Sources()) {
+      LOG(debug) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                 << "' is stale" << std::endl;
+      return false;
+    }
+
+    int64_t age{time(nullptr) - header.created};
+    if (age < 0 || age > IDENTITY_SNAPSHOT_TTL) {
+      LOG(debug) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                 << "' expired" << std::endl;
+      return false;
+    }
+
+    // every entry takes more than a byte, don't trust the header blindly
+    auto size = static_cast<uint64_t>(mapping_->View().size());
+    if (header.users > size || header.groups > size) {
+      LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                   << "' is corrupted" << std::endl;
+      return false;
+    }
+
+    users_.resize(header.users);
+    for (size_t i = 0; i < users_.size(); i++) {
+      struct passwd &pw = users_[i];
+      uint32_t uid{0}, gid{0};
+      const char *name{nullptr}, *dir{nullptr}, *shell{nullptr};
+      if (!reader.Take(&uid) || !reader.Take(&gid) || !reader.Take(&name) ||
+          !reader.Take(&dir) || !reader.Take(&shell)) {
+        LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                     << "' is corrupted" << std::endl;
+        return false;
+      }
+      pw.pw_uid = uid;
+      pw.pw_gid = gid;
+      pw.pw_name = const_cast<char *>(name);
+      pw.pw_dir = const_cast<char *>(dir);
+      pw.pw_shell = const_cast<char *>(shell);
+
+      user_names_.emplace(name, i);
+      uids_.emplace(uid, i);
+    }
+
+    groups_.resize(header.groups);
+    members_.resize(header.groups);
+    for (size_t i = 0; i < groups_.size(); i++) {
+      struct group &gr = groups_[i];
+      uint32_t gid{0}, nmembers{0};
+      const char *name{nullptr};
+      if (!reader.Take(&gid) || !reader.Take(&name) ||
+          !reader.Take(&nmembers) || nmembers > size) {
+        LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                     << "' is corrupted" << std::endl;
+        return false;
+      }
+
+      for (uint32_t j = 0; j < nmembers; j++) {
+        const char *member{nullptr};
+        if (!reader.Take(&member)) {
+          LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                       << "' is corrupted" << std::endl;
+          return false;
+        }
+        members_[i].emplace_back(const_cast<char *>(member));
+      }
+      members_[i].emplace_back(nullptr);
+
+      gr.gr_gid = gid;
+      gr.gr_name = const_cast<char *>(name);
+      gr.gr_mem = members_[i].data();
+
+      group_names_.emplace(name, i);
+      gids_.emplace(gid, i);
+    }
+
+    if (!reader.Done()) {
+      LOG(warning) << "identity snapshot '" << PATH_IDENTITY_SNAPSHOT
+                   << "' is corrupted" << std::endl;
+      return false;
+    }
+  } catch (suex::IOError &e) {
+    LOG(warning) << "couldn't read identity snapshot: " << e.what()
+                 << std::endl;
+    return false;
+  } catch (SuExError &e) {
+    // i.e PATH_CONFIG_DIR is insecure, so the snapshot can't be trusted
+    LOG(warning) << "couldn't read identity snapshot: " << e.what()
+                 << std::endl;
+    return false;
+  }
+
+  LOG(debug) << "loaded " << users_.size() << " users and " << groups_.size()
+             << " groups from '" << PATH_IDENTITY_SNAPSHOT << "'" << std::endl;
+  return true;
+}
+
+void IdentitySnapshot::Build(const file::File &conf) {
+  if (geteuid() != 0 || !SecureDirectory()) {
+    throw suex::IOError("'%s' is not secure", PATH_SUEX_CACHE);
+  }
+
+  // root & wheel are looked up by suex itself
+  std::set<std::string> users{"root"};
+  std::set<std::string> groups{"wheel"};
+  auto collect = [&](const file::line_t &line) {
+    rule_t rule{};
+    if (!Tokenize(line.txt, line.lineno, &rule)) {
+      return;
+    }
+
+    if (rule.user.starts_with(":")) {
+      groups.emplace(rule.user.substr(1).ToString());
+    } else {
+      users.emplace(rule.user.ToString());
+    }
+    users.emplace(rule.as.ToString());
+  };
+
+  conf.ReadLine(collect);
+  for (const std::string &path : ConfigFragments()) {
+    file::File(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC).ReadLine(collect);
+  }
+
+  snapshot_header_t header{};
+  std::strncpy(header.magic, IDENTITY_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = IDENTITY_SNAPSHOT_VERSION;
+  header.created = time(nullptr);
+  header.generation = Generation(conf.Status());
+  header.sources = Sources();
+
+  // the groups the users are in have to be resolvable as well,
+  // that's how the running user's groups are matched.
+  std::set<gid_t> gids;
+  std::string users_buff;
+  for (const std::string &name : users) {
+    const struct passwd *pw = getpwnam(name.c_str());
+    if (pw == nullptr) {
+      continue;
+    }
+
+    Append(&users_buff, static_cast<uint32_t>(pw->pw_uid));
+    Append(&users_buff, static_cast<uint32_t>(pw->pw_gid));
+    AppendCString(&users_buff, pw->pw_name);
+    AppendCString(&users_buff, pw->pw_dir);
+    AppendCString(&users_buff, pw->pw_shell);
+
+    for (gid_t gid : nss::QueryGroupList(name, pw->pw_gid)) {
+      gids.emplace(gid);
+    }
+    header.users++;
+  }
+
+  std::string groups_buff;
+  auto append_group = [&](const struct group *gr) {
+    if (gr == nullptr) {
+      return;
+    }
+
+    Append(&groups_buff, static_cast<uint32_t>(gr->gr_gid));
+    AppendCString(&groups_buff, gr->gr_name);
+    uint32_t nmembers{0};
+    for (auto it = gr->gr_mem; *it != nullptr; it++) {
+      nmembers++;
+    }
+    Append(&groups_buff, nmembers);
+    for (auto it = gr->gr_mem; *it != nullptr; it++) {
+      AppendCString(&groups_buff, *it);
+    }
+    header.groups++;
+  };
+
+  for (const std::string &name : groups) {
+    const struct group *gr = getgrnam(name.c_str());
+    if (gr != nullptr && gids.find(gr->gr_gid) == gids.end()) {
+      append_group(gr);
+    }
+  }
+  for (gid_t gid : gids) {
+    append_group(getgrgid(gid));
+  }
+
+  std::string buff;
+  Append(&buff, header);
+  buff.append(users_buff);
+  buff.append(groups_buff);
+
+  // readers never see a partially written snapshot
+  std::string tmp_path{Sprintf("%s.%d", PATH_IDENTITY_SNAPSHOT, getpid())};
+  try {
+    file::File f{tmp_path,
+                 O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW | O_CLOEXEC,
+                 S_IRUSR | S_IRGRP};
+    if (f.Write(gsl::make_span(buff.data(), buff.size())) !=
+        static_cast<ssize_t>(buff.size())) {
+      throw suex::IOError("short write to '%s'", tmp_path.c_str());
+    }
+    if (rename(tmp_path.c_str(), PATH_IDENTITY_SNAPSHOT) < 0) {
+      throw suex::IOError("rename('%s') failed: %s", tmp_path.c_str(),
+                          std::strerror(errno));
+    }
+  } catch (suex::IOError &) {
+    unlink(tmp_path.c_str());
+    throw;
+  }
+
+  LOG(debug) << "snapshot " << header.users << " users and " << header.groups
+             << " groups in '" << PATH_IDENTITY_SNAPSHOT << "'" << std::endl;
+}
+
+const struct passwd *IdentitySnapshot::GetPasswd(
+    const std::string &name) const {
+  auto it = user_names_.find(name);
+  return it == user_names_.end() ? nullptr : &users_[it->second];
+}
+
+const struct passwd *IdentitySnapshot::GetPasswd(uid_t uid) const {
+  auto it = uids_.find(uid);
+  return it == uids_.end() ? nullptr : &users_[it->second];
+}
+
+const struct group *IdentitySnapshot::GetGroup(const std::string &name) const {
+  auto it = group_names_.find(name);
+  return it == group_names_.end() ? nullptr : &groups_[it->second];
+}
+
+const struct group *IdentitySnapshot::GetGroup(gid_t gid) const {
+  auto it = gids_.find(gid);
+  return it == gids_.end() ? nullptr : &groups_[it->second];
+}
@@ -1,20 +1,34 @@
+#include <dirent.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <atomic>
 #include <conf.hpp>
 #include <logger.hpp>
-#include <rx.hpp>
+#include <recorder.hpp>
 #include <sstream>
+#include <thread>
 
 using suex::permissions::Entity;
 using suex::permissions::Group;
 using suex::permissions::Group;
 using suex::permissions::Permissions;
+using suex::permissions::PolicyCache;
+using suex::permissions::rule_t;
 using suex::permissions::User;
 
 permissions::Permissions::Permissions(Permissions &other) noexcept
     : auth_style_{std::move(other.auth_style_)},
       perms_{std::move(other.perms_)},
+      index_{std::move(other.index_)},
+      group_index_{std::move(other.group_index_)},
+      arena_{std::move(other.arena_)},
+      lines_{std::move(other.lines_)},
+      mode_{other.mode_},
+      rules_{other.rules_},
+      error_{std::move(other.error_)},
       f_{other.f_} {
-  other.perms_ = std::vector<Entity>();
+  other.arena_ = std::make_unique<Arena>();
+  other.Clear();
   other.f_.Invalidate();
 }
 
@@ -78,22 +92,25 @@ const std::vector<User> &GetUsers(const std::string &user,
   return *users;
 }
 
+bool IsExecutable(const file::stat_t &st) {
+  // ignore non executables
+  return (st.st_mode & S_IEXEC) == S_IEXEC && S_ISREG(st.st_mode);
+}
+
 bool IsExecutable(const std::string &path) {
   file::stat_t st{0};
   if (stat(path.c_str(), &st) < 0) {
     throw suex::IOError("couldn't get executable '%s' stat: %s", path.c_str(),
                         std::strerror(errno));
   }
-  // ignore non executables
-  return (st.st_mode & S_IEXEC) == S_IEXEC && S_ISREG(st.st_mode);
+  return IsExecutable(st);
 }
 
 const std::vector<std::string> &GetExecutables(const std::string &glob_pattern,
                                                std::vector<std::string> *vec) {
   glob_t globbuf{0};
   if (glob(glob_pattern.c_str(), 0, nullptr, &globbuf) != 0) {
-    logger::warning() << "there are no executables at " << glob_pattern
-                      << std::endl;
+    LOG(warning) << "there are no executables at " << glob_pattern << std::endl;
     return *vec;
   }
   DEFER(globfree(&globbuf));
@@ -114,6 +131,10 @@ const std::vector<std::string> &GetExecutables(const std::string &glob_pattern,
   return *vec;
 }
 
+bool IsGlob(const std::string &cmd) {
+  return cmd.find_first_of("*?[") != std::string::npos;
+}
+
 std::string ParseCommand(const std::string &cmd, const std::string &args) {
   if (args.empty()) {
     return cmd;
@@ -138,107 +159,503 @@ std::string ParseCommand(const std::string &cmd, const std::string &args) {
   return ss.str();
 };
 
-void ParseOptions(const std::string &options, bool *nopass, bool *keepenv,
-                  bool *persist, Entity::EnvToAdd *env_to_add,
-                  Entity::EnvToRemove *env_to_remove) {
-  if (options.empty()) {
-    return;
+std::vector<std::string> permissions::ConfigFragments() {
+  std::vector<std::string> fragments;
+  file::stat_t st{0};
+  if (lstat(PATH_CONFIG_DIR, &st) != 0) {
+    return fragments;
   }
-  std::string opt_match{};
-  re2::StringPiece sp{options};
-  while (re2::RE2::FindAndConsume(&sp, permissions::PermissionsOptionsRegex(),
-                                  &opt_match)) {
-    if (opt_match == "nopass") {
-      *nopass = true;
-    }
-    if (opt_match == "keepenv") {
-      *keepenv = true;
+
+  // nobody but root should be able to drop permissions in
+  if (!S_ISDIR(st.st_mode) || st.st_uid != 0 ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    throw suex::PermissionError("'%s' is not secure", PATH_CONFIG_DIR);
+  }
+
+  DIR *dir = opendir(PATH_CONFIG_DIR);
+  if (dir == nullptr) {
+    throw suex::IOError("opendir('%s') failed: %s", PATH_CONFIG_DIR,
+                        std::strerror(errno));
+  }
+  DEFER(closedir(dir));
+
+  std::string ext{".conf"};
+  for (dirent *ent = readdir(dir); ent != nullptr; ent = readdir(dir)) {
+    // hidden files, editor backups and the like are skipped
+    std::string name{ent->d_name};
+    if (name[0] == '.' || name.size() <= ext.size() ||
+        name.compare(name.size() - ext.size(), ext.size(), ext) != 0) {
+      continue;
     }
-    if (opt_match == "persist") {
-      *persist = true;
+
+    std::string path{PATH_CONFIG_DIR "/" + name};
+    if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      fragments.emplace_back(path);
     }
-    if (opt_match.find("setenv") == 0) {
-      ProcessEnv(opt_match, env_to_add, env_to_remove);
+  }
+
+  // byte order, so it doesn't depend on the locale
+  std::sort(fragments.begin(), fragments.end());
+  return fragments;
+}
+
+// the errors of a fragment's rule name the fragment, since its line numbers
+// are its own
+void ThrowFromFragment(const rule_t &rule, const SuExError &e) {
+  if (rule.fragment == nullptr) {
+    throw;
+  }
+  throw suex::ConfigError("'%s' line %d: %s", rule.fragment, rule.lineno,
+                          e.what());
+}
+
+// fragments are dropped in by packages, with whatever mode they install them
+// with. File::IsSecure is suex.conf's check (the mode 'suex -E' publishes it
+// with), so fragments are held to what the directory is held to instead:
+// owned by root, and writable by nobody else.
+void CheckFragment(const file::File &f) {
+  const file::stat_t st = f.Status();
+  if (!S_ISREG(st.st_mode) || st.st_uid != 0 ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    throw suex::PermissionError("'%s' is not secure", f.Path().c_str());
+  }
+  if (f.Size() > MAX_FILE_SIZE) {
+    throw suex::PermissionError("'%s' size is %ld, which is not supported",
+                                f.Path().c_str(), static_cast<long>(f.Size()));
+  }
+}
+
+// tokenizes a configuration file, or reads its rules from the cache, in
+// which case the file isn't read. the rules are views into the copy of the
+// file or the cache, which are kept so they outlive them.
+void ReadFile(const file::File &f, bool cache, const char *fragment,
+              int fragment_index, std::vector<rule_t> *rules, std::vector<file::Mapping> *mappings,
+              std::vector<std::unique_ptr<PolicyCache>> *caches) {
+  std::vector<rule_t> file_rules;
+  if (cache) {
+    caches->emplace_back(std::make_unique<PolicyCache>(f));
+  }
+
+  if (!cache || !caches->back()->Read(&file_rules)) {
+    mappings->emplace_back(f.Copy());
+    mappings->back().ReadLine([&](const file::line_t &line) {
+      rule_t rule{};
+      try {
+        if (Tokenize(line.txt, line.lineno, &rule)) {
+          file_rules.emplace_back(rule);
+        }
+      } catch (SuExError &e) {
+        rule.lineno = line.lineno;
+        rule.fragment = fragment;
+        rule.fragment_index = fragment_index;
+        ThrowFromFragment(rule, e);
+      }
+    });
+
+    if (cache) {
+      caches->back()->Write(file_rules);
     }
   }
+
+  for (rule_t &rule : file_rules) {
+    rule.fragment = fragment;
+    rule.fragment_index = fragment_index;
+  }
+  rules->insert(rules->end(), file_rules.begin(), file_rules.end());
 }
 
-void permissions::Permissions::Parse(
-    const file::line_t &line, std::function<void(const Entity &)> &&callback) {
-  logger::debug() << "parsing line " << line.lineno << ": '" << line.txt << "'"
-                  << std::endl;
+void permissions::Permissions::ReadRules(
+    std::function<void(const std::vector<rule_t> &)> &&callback) {
+  std::vector<rule_t> rules;
+  std::vector<std::string> fragments;
+  std::vector<file::Mapping> mappings;
+  std::vector<std::unique_ptr<PolicyCache>> caches;
 
-  //  a comment, no need to parse
-  if (re2::RE2::FullMatch(line.txt, CommentLineRegex())) {
-    logger::debug() << "line " << line.lineno << " is a comment, skipping."
-                    << std::endl;
-    return;
+  // an invalid line (or fragment) stops the reading, but the rules before it
+  // are still expanded: their errors come first.
+  std::exception_ptr error;
+  try {
+    // only the system wide configuration & its fragments are cached.
+    // each one is cached separately, so changing a fragment only re-parses
+    // that fragment.
+    bool system{f_.Path() == PATH_CONFIG};
+    ReadFile(f_, system, nullptr, 0, &rules, &mappings, &caches);
+
+    // the rules point at the fragments' paths
+    if (system) {
+      fragments = ConfigFragments();
+    }
+    for (size_t i = 0; i < fragments.size(); i++) {
+      const std::string &path{fragments[i]};
+      file::File f{path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC};
+      LOG(debug) << "parsing '" << f.String() << std::endl;
+      CheckFragment(f);
+      ReadFile(f, true, path.c_str(), static_cast<int>(i + 1), &rules,
+               &mappings, &caches);
+    }
+  } catch (SuExError &) {
+    error = std::current_exception();
   }
 
-  //  an empty line, no need to parse
-  if (re2::RE2::FullMatch(line.txt, EmptyLineRegex())) {
-    logger::debug() << "line " << line.lineno << " is empty, skipping."
-                    << std::endl;
-    return;
+  callback(rules);
+  if (error != nullptr) {
+    std::rethrow_exception(error);
   }
+}
 
-  utils::rx::Matches m;
-  if (!utils::rx::NamedFullMatch(PermissionLineRegex(), line.txt, &m)) {
-    logger::debug() << "couldn't parse: " << line.txt << std::endl;
-    throw ConfigError("line is invalid: '%s'", line.txt.c_str());
+bool AppliesToRunningUser(const rule_t &rule) {
+  // groups are compared by name, so skipped rules aren't looked up at all
+  static const std::set<std::string> groups = [] {
+    std::set<std::string> names;
+    for (gid_t gid : RunningUserGroups()) {
+      names.emplace(Group(gid, false).Name());
+    }
+    return names;
+  }();
+
+  if (rule.user.starts_with(":")) {
+    re2::StringPiece name{rule.user.substr(1)};
+    return groups.find(name.as_string()) != groups.end();
   }
 
-  bool nopass{false}, keepenv{false}, persist{false};
-  Entity::EnvToRemove env_to_remove;
-  Entity::EnvToAdd env_to_add;
-  ParseOptions(m["options"], &nopass, &keepenv, &persist, &env_to_add,
-               &env_to_remove);
+  return rule.user == RunningUser().Name();
+}
+
+void permissions::Permissions::Expand(
+    const rule_t &rule, std::function<void(const Entity &)> &&callback) {
+  if (mode_ == LAZY && !AppliesToRunningUser(rule)) {
+    LOG(debug) << "line " << rule.lineno << " doesn't apply to "
+               << RunningUser().Name() << ", skipping." << std::endl;
+    return;
+  }
 
-  bool deny = m["type"] == "deny";
+  // shared by all the entities of the line
+  const Entity::Env *env{nullptr};
+  if (!rule.env.empty()) {
+    Entity::Env block;
+    ProcessEnv(rule.env.as_string(), &block.add, &block.remove);
+    if (!block.add.empty() || !block.remove.empty()) {
+      env = arena_->Add(std::move(block));
+    }
+  }
 
   // extract the destination user
-  User as_user = User(m["as"]);
+  User as_user = User(rule.as.as_string());
   if (!as_user.Exists()) {
     throw suex::PermissionError("destination user '%s' doesn't exist",
                                 as_user.Name().c_str());
   }
 
   // disallow running any cmd as root with nopass
-  if (m["cmd"].empty() && nopass && as_user.Id() == 0) {
+  if (rule.cmd.empty() && rule.nopass && as_user.Id() == 0) {
     throw suex::PermissionError("cmd doesn't exist but nopass is set");
   }
 
   std::vector<std::string> binaries;
-  for (const auto &exe : GetExecutables(m["cmd"], &binaries)) {
+  std::string cmd{rule.cmd.as_string()};
+  std::string cmd_glob;
+  if (mode_ != FULL && IsGlob(cmd)) {
+    // matched against the executable when looked up
+    binaries.emplace_back(cmd);
+    cmd_glob = cmd;
+  } else {
+    GetExecutables(cmd, &binaries);
+  }
+
+  std::string owner{rule.user.as_string()};
+  if (mode_ != FULL && owner[0] == ':' && !binaries.empty()) {
+    // matched against the running user's groups when looked up
+    Group grp{owner.substr(1, owner.npos), false};
+    if (!grp.Exists()) {
+      throw suex::PermissionError("group %s doesn't exist",
+                                  grp.Name().c_str());
+    }
+
+    for (const auto &exe : binaries) {
+      std::string cmd_re{ParseCommand(exe, rule.args.as_string())};
+      permissions::Entity e(arena_.get(), grp, as_user, rule.deny,
+                            rule.keepenv, rule.nopass, rule.persist, env,
+                            rule.lineno, cmd_re, cmd_glob);
+      e.SetFragment(rule.fragment_index);
+      callback(e);
+    }
+    LOG(debug) << "line " << rule.lineno << " parsed successfully" << std::endl;
+    return;
+  }
+
+  // groups are expanded once, not once per executable
+  std::vector<User> users;
+  if (!binaries.empty()) {
+    GetUsers(owner, &users);
+  }
+
+  for (const auto &exe : binaries) {
     // populate the permissions vector
-    std::vector<User> users;
-    for (const User &user : GetUsers(m["user"], &users)) {
+    for (const User &user : users) {
       if (!user.Exists()) {
         throw suex::PermissionError("user '%s' doesn't exist",
                                     user.Name().c_str());
       }
 
       // parse the args
-      std::string cmd_re{ParseCommand(exe, m["args"])};
-      callback(permissions::Entity(user, as_user, deny, keepenv, nopass,
-                                   persist, env_to_add, env_to_remove, cmd_re));
+      std::string cmd_re{ParseCommand(exe, rule.args.as_string())};
+      permissions::Entity e(arena_.get(), user, as_user, rule.deny,
+                            rule.keepenv, rule.nopass, rule.persist, env,
+                            rule.lineno, cmd_re, cmd_glob);
+      e.SetFragment(rule.fragment_index);
+      callback(e);
+    }
+  }
+  LOG(debug) << "line " << rule.lineno << " parsed successfully" << std::endl;
+}
+
+void permissions::Permissions::ExpandAll(
+    const std::vector<rule_t> &rules,
+    std::function<void(const Entity &)> &&callback) {
+  size_t chunks{(rules.size() + LOAD_CHUNK_SIZE - 1) / LOAD_CHUNK_SIZE};
+  size_t workers{std::min<size_t>(std::thread::hardware_concurrency(), chunks)};
+
+  auto expand = [this](const rule_t &rule,
+                       std::function<void(const Entity &)> &&callback) {
+    try {
+      Expand(rule, std::move(callback));
+    } catch (SuExError &e) {
+      ThrowFromFragment(rule, e);
+    }
+  };
+
+  // the verbose output of the workers would interleave
+  if (workers <= 1 || logger::debug().Verbose()) {
+    for (const rule_t &rule : rules) {
+      expand(rule, [&](const Entity &e) { callback(e); });
+    }
+    return;
+  }
+
+  struct chunk_t {
+    std::vector<Entity> entities;
+    std::exception_ptr error;
+  };
+
+  // chunks are taken in order, and the ones after the first failing chunk
+  // are skipped: the lowest failing line is the only one reported.
+  std::vector<chunk_t> results(chunks);
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> failed{chunks};
+  auto work = [&] {
+    for (size_t i = next++; i < chunks && i < failed; i = next++) {
+      auto begin = rules.begin() + i * LOAD_CHUNK_SIZE;
+      auto end = i == chunks - 1 ? rules.end() : begin + LOAD_CHUNK_SIZE;
+      try {
+        for (auto it = begin; it != end; it++) {
+          expand(*it, [&](const Entity &e) {
+            results[i].entities.emplace_back(e);
+          });
+        }
+      } catch (...) {
+        results[i].error = std::current_exception();
+        size_t lowest{failed};
+        while (i < lowest && !failed.compare_exchange_weak(lowest, i)) {
+        }
+      }
+    }
+  };
+
+  {
+    std::vector<std::thread> pool;
+    DEFER(for (std::thread &t : pool) { t.join(); });
+    for (size_t i = 1; i < workers; i++) {
+      pool.emplace_back(work);
+    }
+    work();
+  }
+
+  // merge in line order, so the last match still wins
+  for (const chunk_t &chunk : results) {
+    if (chunk.error != nullptr) {
+      std::rethrow_exception(chunk.error);
+    }
+    for (const Entity &e : chunk.entities) {
+      callback(e);
+    }
+  }
+}
+
+uint64_t IndexKey(int owner_id, int as_id) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(owner_id)) << 32 |
+         static_cast<uint32_t>(as_id);
+}
+
+void Permissions::Add(const Entity &e) {
+  if (e.IsGroup()) {
+    group_index_[IndexKey(e.GroupId(), e.AsUserId())].emplace_back(
+        perms_.size());
+  } else {
+    index_[IndexKey(e.OwnerId(), e.AsUserId())].emplace_back(
+        perms_.size());
+  }
+  perms_.emplace_back(e);
+}
+
+void Permissions::AddPrivileged() {
+  // if the user is privileged, add an "all rule" to the
+  // beginning of the permissions vector
+  bool deny{false}, keepenv{true}, nopass{false}, persist(true);
+  if (mode_ == SHARED) {
+    // the caller isn't known yet, so it's added for every privileged user
+    if (WheelGroup().Exists()) {
+      Add(permissions::Entity(arena_.get(), WheelGroup(), RootUser(), deny,
+                              keepenv, nopass, persist, nullptr, 0, ".+"));
     }
+    return;
   }
-  logger::debug() << "line " << line.lineno << " parsed successfully"
-                  << std::endl;
+
+  if (Privileged()) {
+    Add(permissions::Entity(arena_.get(), RunningUser(), RootUser(), deny,
+                            keepenv, nopass, persist, nullptr, 0, ".+"));
+  }
+}
+
+// clears the loaded permissions, but keeps their strings in the arena
+void Permissions::Reset() {
+  matchers_.Clear();
+  resolved_.Clear();
+  index_.clear();
+  group_index_.clear();
+  perms_.clear();
+}
+
+void Permissions::Clear() {
+  Reset();
+  // the remembered lines point into the arena
+  lines_.clear();
+  arena_->Clear();
+}
+
+std::shared_ptr<const permissions::Matcher> Permissions::GetMatcher(
+    const User &caller, const std::vector<gid_t> &groups,
+    const User &user) const {
+  uint64_t key{IndexKey(caller.Id(), user.Id())};
+  auto matcher_key = std::make_pair(key, groups);
+  auto cached = [&] {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    return matchers_.Find(matcher_key);
+  };
+  std::shared_ptr<const Matcher> found{cached()};
+  if (found != nullptr) {
+    return found;
+  }
+
+  // concurrent lookups wait for the matcher that's being built, instead of
+  // building it again
+  std::lock_guard<std::mutex> build_lock{build_mutex_};
+  found = cached();
+  if (found != nullptr) {
+    return found;
+  }
+
+  // the caller's entities, and the entities of the groups it's in
+  std::vector<size_t> indices;
+  auto bucket = index_.find(key);
+  if (bucket != index_.end()) {
+    indices = bucket->second;
+  }
+
+  for (gid_t gid : groups) {
+    bucket = group_index_.find(IndexKey(static_cast<int>(gid), user.Id()));
+    if (bucket != group_index_.end()) {
+      indices.insert(indices.end(), bucket->second.begin(),
+                     bucket->second.end());
+    }
+  }
+
+  // keep the configuration order, the last match wins
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+  std::vector<const Entity *> entities;
+  for (size_t idx : indices) {
+    entities.emplace_back(&perms_[idx]);
+  }
+
+  recorder::Span span{recorder::RULE, "matcher for", user.Name().c_str()};
+  auto matcher = std::make_shared<const Matcher>(std::move(entities));
+  span.Value(static_cast<int64_t>(matcher->Size()));
+  LOG(debug) << "matcher for " << user.Name() << " has " << matcher->Size()
+             << " entities" << std::endl;
+
+  std::lock_guard<std::mutex> lock{cache_mutex_};
+  return matchers_.Insert(matcher_key, std::move(matcher));
+}
+
+// a resolved glob entity, and the arena of its command. it isn't kept in the
+// arena of the permissions, which would grow with every executable resolved.
+struct resolved_t {
+  resolved_t(const Entity &e, const std::string &exe)
+      : entity{e.Resolve(&arena, exe)} {}
+
+  permissions::Arena arena;
+  Entity entity;
+};
+
+std::shared_ptr<const Entity> Permissions::Resolve(
+    const Entity &e, const std::string &exe) const {
+  std::lock_guard<std::mutex> lock{cache_mutex_};
+  auto key = std::make_pair(&e, exe);
+  std::shared_ptr<const Entity> found{resolved_.Find(key)};
+  if (found != nullptr) {
+    return found;
+  }
+  auto resolved = std::make_shared<const resolved_t>(e, exe);
+  return resolved_.Insert(
+      key, std::shared_ptr<const Entity>{resolved, &resolved->entity});
 }
 
 const Entity *Permissions::Get(const permissions::User &user,
                                const std::vector<char *> &cmdargv) const {
-  std::string cmd = std::string(*cmdargv.data());
+  return Get(RunningUser(), RunningUserGroups(), user, cmdargv);
+}
+
+const Entity *Permissions::Get(const User &caller,
+                               const std::vector<gid_t> &groups,
+                               const permissions::User &user,
+                               const std::vector<char *> &cmdargv) const {
+  std::string exe{*cmdargv.data()};
   std::string cmdtxt{utils::CommandArgsText(cmdargv)};
 
-  // take the latest one you find (like the original suex)
-  const Entity *perm = nullptr;
-  for (const permissions::Entity &p : perms_) {
-    if (p.CanExecute(user, cmdtxt)) {
-      perm = &p;
+  // glob entities are expanded to the executable only if it matches.
+  // the executable is up to the caller (i.e of suexd), so one that doesn't
+  // exist isn't matched, rather than failing the lookup.
+  auto glob_matcher = [&](const Entity &e) {
+    if (fnmatch(e.CommandGlob().c_str(), exe.c_str(),
+                FNM_PATHNAME | FNM_PERIOD) != 0) {
+      return false;
     }
+    // the resolved entity is kept, so its regex is compiled only once
+    file::stat_t st{0};
+    return stat(exe.c_str(), &st) == 0 && IsExecutable(st) &&
+           re2::RE2::FullMatch(cmdtxt, Resolve(e, exe)->CommandRegex());
+  };
+
+  // take the latest one you find (like the original suex)
+  std::shared_ptr<const Matcher> matcher{GetMatcher(caller, groups, user)};
+  int64_t start{recorder::Now()};
+  const Entity *perm = matcher->Match(cmdtxt, glob_matcher);
+  if (perm != nullptr && perm->IsGlob()) {
+    // it may be dropped from resolved_ by another thread, so it's kept until
+    // the thread's next Get
+    static thread_local std::shared_ptr<const Entity> resolved;
+    resolved = Resolve(*perm, exe);
+    perm = resolved.get();
+  }
+
+  // 1 if it's permitted, 0 if it's denied & -1 if no rule matched
+  recorder::Record(recorder::RULE, cmdtxt.c_str(),
+                   perm == nullptr ? "-" : perm->Command().c_str(),
+                   perm == nullptr ? -1 : perm->Deny() ? 0 : 1,
+                   recorder::Now() - start);
+  if (perm != nullptr) {
+    LOG(debug) << "[!] " << perm->Command() << " ~= " << cmdtxt << std::endl;
   }
 
   return perm;
@@ -252,79 +669,119 @@ Permissions::Permissions(const std::string &path, std::string auth_style)
       f_{path, O_CREAT | O_RDONLY, S_IRUSR | S_IRGRP} {}
 
 Permissions &Permissions::Reload() {
-  if (!perms_.empty()) {
-    perms_.clear();
+  Clear();
+  return Load(mode_);
+}
+
+Permissions &Permissions::Revalidate() {
+  LOG(debug) << "re-validating '" << f_.String() << std::endl;
+  if (f_.Path() == PATH_CONFIG && !f_.IsSecure()) {
+    throw suex::PermissionError("'%s' is not secure", f_.Path().c_str());
+  }
+
+  if (f_.Size() > MAX_FILE_SIZE) {
+    throw suex::PermissionError("'%s' size is %ld, which is not supported",
+                                f_.Path().c_str(),
+                                static_cast<long>(f_.Size()));
+  }
+
+  Reset();
+  AddPrivileged();
+
+  // lines are compared by their text, so moving a line around doesn't make
+  // it a changed line (its entities take its new line number). lines that
+  // were removed are forgotten.
+  std::unordered_map<std::string, line_result_t> lines;
+  size_t changed{0}, invalid{0};
+  auto mapping = f_.Copy();
+  mapping.ReadLine([&](const file::line_t &line) {
+    std::string txt{line.txt.as_string()};
+    auto it = lines.find(txt);
+    if (it == lines.end()) {
+      auto prev = lines_.find(txt);
+      if (prev != lines_.end()) {
+        it = lines.emplace(txt, std::move(prev->second)).first;
+        lines_.erase(prev);
+      } else {
+        line_result_t result;
+        try {
+          rule_t rule{};
+          if (Tokenize(line.txt, line.lineno, &rule)) {
+            Expand(rule, [&](const Entity &e) {
+              result.entities.emplace_back(e);
+            });
+          }
+        } catch (SuExError &e) {
+          result.entities.clear();
+          result.error = e.what();
+        }
+        it = lines.emplace(txt, std::move(result)).first;
+        changed++;
+      }
+    }
+
+    // every invalid line is reported, whether or not it's verbose. it's
+    // the line of the file that's being edited, which is a temporary one.
+    if (!it->second.error.empty()) {
+      std::cerr << "line " << line.lineno << ": " << it->second.error
+                << std::endl;
+      invalid++;
+      return;
+    }
+
+    for (Entity e : it->second.entities) {
+      e.SetLineNumber(line.lineno);
+      Add(e);
+    }
+  });
+  lines_ = std::move(lines);
+
+  LOG(debug) << "re-validated " << changed << " changed lines, " << invalid
+             << " lines are invalid" << std::endl;
+  if (invalid > 0) {
+    Reset();
   }
-  return Load();
+  return *this;
 }
 
-Permissions &Permissions::Load() {
+Permissions &Permissions::Load(LoadMode mode) {
   if (!perms_.empty()) {
     throw ConfigError("not allowed to reload configuration");
   }
-
-  file::Flock flock{f_, F_RDLCK};
-
-  logger::debug() << "parsing '" << f_.String() << std::endl;
+  mode_ = mode;
+  rules_ = 0;
+  error_.clear();
+
+  // edits publish a new generation of the configuration (see File::Publish),
+  // so it's read without a lock. it's copied rather than mapped, so a file
+  // that's written in place anyway can't crash the reader (see File::Copy).
+  LOG(debug) << "parsing '" << f_.String() << std::endl;
   if (f_.Path() == PATH_CONFIG && !f_.IsSecure()) {
     throw suex::PermissionError("'%s' is not secure", f_.Path().c_str());
   }
 
   if (f_.Size() > MAX_FILE_SIZE) {
     throw suex::PermissionError("'%s' size is %ld, which is not supported",
-                                f_.Path().c_str(), f_.Size() / 1024.0);
+                                f_.Path().c_str(),
+                                static_cast<long>(f_.Size()));
   }
 
+  AddPrivileged();
+
   try {
-    f_.ReadLine([&](const file::line_t &line) {
-      Parse(line, [&](const Entity &e) { perms_.emplace_back(e); });
+    ReadRules([&](const std::vector<rule_t> &rules) {
+      rules_ = rules.size();
+      ExpandAll(rules, [&](const Entity &e) { Add(e); });
     });
   } catch (SuExError &e) {
     // configuration is invalid.
     // clear all loaded permissions and log
-    perms_.clear();
-    logger::error() << e.what() << std::endl;
+    Clear();
+    error_ = e.what();
+    recorder::Record(recorder::ERROR, e.what());
+    LOG(error) << e.what() << std::endl;
     return *this;
   }
 
-  // if the user is privileged, add an "all rule" to the
-  // beginning of the permissions vector
-  if (Privileged()) {
-    bool deny{false}, keepenv{true}, nopass{false}, persist(true);
-    auto p = permissions::Entity(RunningUser(), RootUser(), deny, keepenv,
-                                 nopass, persist, ".+");
-    perms_.emplace(perms_.begin(), p);
-  }
-
   return *this;
 }
-
-const re2::RE2 &permissions::PermissionsOptionsRegex() {
-  static const re2::RE2 re{R"((nopass|persist|keepenv|setenv\s\{.*\}))"};
-  if (!re.ok()) {
-    throw std::runtime_error("permissions options regex failed to compile");
-  }
-  return re;
-}
-const re2::RE2 &permissions::PermissionLineRegex() {
-  static const re2::RE2 re{
-      R"(^(?P<type>permit|deny)\s+((?P<options>.*)\s+)?(?P<user>(:)?[a-z_][a-z0-9_-]*[$]?)\s+as\s+(?P<as>[a-z_][a-z0-9_-]*[$]?)\s+cmd\s+(?P<cmd>[^\s]+)(\s+args\s+((?P<args>[^\s].*[^\s])[\s]*))?\s*$)"};
-  if (!re.ok()) {
-    throw std::runtime_error("permissions regex failed to compile");
-  }
-  return re;
-}
-const re2::RE2 &permissions::CommentLineRegex() {
-  static const re2::RE2 re{R"(^[\t|\s]*#.*)"};
-  if (!re.ok()) {
-    throw std::runtime_error("comment regex failed to compile");
-  }
-  return re;
-}
-const re2::RE2 &permissions::EmptyLineRegex() {
-  static const re2::RE2 re{R"(^[\t|\s]*)"};
-  if (!re.ok()) {
-    throw std::runtime_error("empty line regex failed to compile");
-  }
-  return re;
-}
@@ -0,0 +1,122 @@
+#include <suex.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <conf.hpp>
+#include <memory>
+#include <nss.hpp>
+#include <utils.hpp>
+#include <version.hpp>
+
+using suex::permissions::Entity;
+using suex::permissions::Permissions;
+using suex::permissions::User;
+
+// the policy owns f's descriptor, which f gives up
+struct suex_policy {
+  explicit suex_policy(suex::file::File &f)
+      : permissions{f, DEFAULT_AUTH_STYLE} {
+    f.Invalidate();
+  }
+
+  Permissions permissions;
+};
+
+thread_local std::string last_error;
+
+// runs fn, and returns fallback if it threw
+template <typename T, typename Fn>
+T Guard(T fallback, Fn fn) {
+  try {
+    return fn();
+  } catch (std::exception &e) {
+    last_error = e.what();
+    return fallback;
+  }
+}
+
+suex_policy_t *Load(suex::file::File &f) {
+  // the policy is evaluated like suexd does, for any caller, and callers are
+  // looked up again on every check
+  suex::nss::TurnOffMemoization();
+  auto policy = std::make_unique<suex_policy_t>(f);
+  policy->permissions.Load(suex::permissions::SHARED);
+  if (!policy->permissions.Error().empty()) {
+    throw suex::ConfigError("%s", policy->permissions.Error().c_str());
+  }
+  return policy.release();
+}
+
+suex_policy_t *suex_policy_load(const char *path) {
+  return Guard<suex_policy_t *>(nullptr, [&] {
+    suex::file::File f{path, O_RDONLY | O_CLOEXEC};
+    return Load(f);
+  });
+}
+
+suex_policy_t *suex_policy_load_buffer(const char *buf, size_t len) {
+  return Guard<suex_policy_t *>(nullptr, [&] {
+    // policies are loaded from a file, so buf is copied into an anonymous one
+    int fd{memfd_create("suex.conf", MFD_CLOEXEC)};
+    if (fd < 0) {
+      throw suex::IOError("memfd_create failed: %s", std::strerror(errno));
+    }
+    suex::file::File f{fd};
+    for (size_t pos = 0; pos < len;) {
+      ssize_t written{write(fd, buf + pos, len - pos)};
+      if (written < 0) {
+        throw suex::IOError("couldn't copy the policy: %s",
+                            std::strerror(errno));
+      }
+      pos += static_cast<size_t>(written);
+    }
+    return Load(f);
+  });
+}
+
+int suex_policy_check(suex_policy_t *policy, uid_t uid, uid_t as_uid,
+                      const char *const argv[], suex_result_t *result) {
+  return Guard(-1, [&] {
+    User caller{uid};
+    User as_user{as_uid};
+    if (!caller.Exists()) {
+      throw suex::PermissionError("uid %d doesn't exist", uid);
+    }
+    if (!as_user.Exists()) {
+      throw suex::PermissionError("uid %d doesn't exist", as_uid);
+    }
+    if (argv == nullptr || argv[0] == nullptr) {
+      throw suex::PermissionError("a command is required");
+    }
+
+    *result = suex_result_t{SUEX_NO_MATCH, 0, 0, 0, 0, 0, nullptr};
+    if (suex::utils::BypassPermissions(caller, as_user)) {
+      result->decision = SUEX_BYPASS;
+      return 0;
+    }
+
+    std::vector<char *> cmdargv;
+    for (const char *const *arg = argv; *arg != nullptr; arg++) {
+      cmdargv.emplace_back(const_cast<char *>(*arg));
+    }
+    cmdargv.emplace_back(nullptr);
+
+    const Entity *perm{policy->permissions.Get(
+        caller, suex::permissions::GetGroups(caller), as_user, cmdargv)};
+    if (perm != nullptr) {
+      result->decision = perm->Deny() ? SUEX_DENY : SUEX_PERMIT;
+      result->lineno = perm->LineNumber();
+      result->nopass = perm->PromptForPassword() ? 0 : 1;
+      result->persist = perm->CacheAuth() ? 1 : 0;
+      result->keepenv = perm->KeepEnvironment() ? 1 : 0;
+      result->setenv = perm->EnvironmentVariablesConfigured() ? 1 : 0;
+      result->command = perm->Command().c_str();
+    }
+    return 0;
+  });
+}
+
+void suex_policy_free(suex_policy_t *policy) { delete policy; }
+
+const char *suex_error() { return last_error.c_str(); }
+
+const char *suex_version() { return VERSION; }
@@ -0,0 +1,88 @@
+#include <logger.hpp>
+#include <matcher.hpp>
+
+using suex::permissions::Entity;
+using suex::permissions::Matcher;
+
+const re2::RE2::Options &MatcherOptions() {
+  static re2::RE2::Options opts = [] {
+    re2::RE2::Options o;
+    o.set_max_mem(MATCHER_MAX_MEM);
+    o.set_log_errors(false);
+    return o;
+  }();
+  return opts;
+}
+
+Matcher::Matcher(std::vector<const Entity *> entities)
+    : entities_{std::move(entities)},
+      set_{MatcherOptions(), re2::RE2::ANCHOR_BOTH} {
+  for (long idx = 0; idx < static_cast<long>(entities_.size()); idx++) {
+    const Entity *e = entities_[idx];
+    if (e->IsGlob()) {
+      globs_.emplace_back(idx);
+      continue;
+    }
+
+    std::string error;
+    if (set_.Add(e->Command(), &error) < 0) {
+      // an invalid regex never matches, same as RE2::FullMatch
+      LOG(debug) << "invalid cmd regex '" << e->Command() << "': " << error
+                 << std::endl;
+      continue;
+    }
+    patterns_.emplace_back(idx);
+  }
+
+  compiled_ = set_.Compile();
+  if (!compiled_) {
+    LOG(debug) << "couldn't compile a matcher for " << patterns_.size()
+               << " patterns" << std::endl;
+  }
+}
+
+const Entity *Matcher::Match(const std::string &cmd,
+                             const GlobMatcher &glob_matcher) const {
+  long last = MatchSet(cmd);
+
+  // a glob entity wins only if it comes after the last match
+  for (auto it = globs_.rbegin(); it != globs_.rend() && *it > last; it++) {
+    if (glob_matcher(*entities_[*it])) {
+      return entities_[*it];
+    }
+  }
+
+  return last < 0 ? nullptr : entities_[last];
+}
+
+long Matcher::MatchSet(const std::string &cmd) const {
+  if (!compiled_) {
+    return MatchEach(cmd);
+  }
+
+  std::vector<int> matches;
+  re2::RE2::Set::ErrorInfo info{re2::RE2::Set::kNoError};
+  if (set_.Match(cmd, &matches, &info)) {
+    // indices are ordered like the entities, take the latest one
+    return patterns_[*std::max_element(matches.begin(), matches.end())];
+  }
+
+  if (info.kind == re2::RE2::Set::kNoError) {
+    return -1;
+  }
+
+  // the DFA ran out of memory, evaluate the entities one by one
+  LOG(debug) << "matcher failed (" << info.kind << "), matching one by one"
+             << std::endl;
+  return MatchEach(cmd);
+}
+
+long Matcher::MatchEach(const std::string &cmd) const {
+  long last = -1;
+  for (long idx : patterns_) {
+    if (re2::RE2::FullMatch(cmd, entities_[idx]->CommandRegex())) {
+      last = idx;
+    }
+  }
+  return last;
+}
@@ -0,0 +1,298 @@
+#include <atomic>
+#include <cache.hpp>
+#include <deque>
+#include <logger.hpp>
+#include <memory>
+#include <mutex>
+#include <nss.hpp>
+#include <recorder.hpp>
+#include <unordered_map>
+#include <vector>
+
+// a deep copy of a passwd entry
+class PasswdEntry {
+ public:
+  typedef struct passwd Raw;
+  typedef uid_t Id;
+
+  explicit PasswdEntry(const struct passwd &pw)
+      : name_{pw.pw_name}, dir_{pw.pw_dir}, shell_{pw.pw_shell}, pw_(pw) {
+    pw_.pw_name = &name_[0];
+    pw_.pw_passwd = nullptr;
+    pw_.pw_gecos = nullptr;
+    pw_.pw_dir = &dir_[0];
+    pw_.pw_shell = &shell_[0];
+  }
+
+  PasswdEntry(const PasswdEntry &) = delete;
+
+  const struct passwd *Get() const { return &pw_; }
+
+  static Id IdOf(const struct passwd &pw) { return pw.pw_uid; }
+
+  static const char *NameOf(const struct passwd &pw) { return pw.pw_name; }
+
+ private:
+  std::string name_;
+  std::string dir_;
+  std::string shell_;
+  struct passwd pw_;
+};
+
+// a deep copy of a group entry
+class GroupEntry {
+ public:
+  typedef struct group Raw;
+  typedef gid_t Id;
+
+  explicit GroupEntry(const struct group &gr) : name_{gr.gr_name}, gr_(gr) {
+    for (auto it = gr.gr_mem; *it != nullptr; it++) {
+      members_.emplace_back(*it);
+    }
+    for (std::string &member : members_) {
+      mem_.emplace_back(&member[0]);
+    }
+    mem_.emplace_back(nullptr);
+
+    gr_.gr_name = &name_[0];
+    gr_.gr_passwd = nullptr;
+    gr_.gr_mem = mem_.data();
+  }
+
+  GroupEntry(const GroupEntry &) = delete;
+
+  const struct group *Get() const { return &gr_; }
+
+  static Id IdOf(const struct group &gr) { return gr.gr_gid; }
+
+  static const char *NameOf(const struct group &gr) { return gr.gr_name; }
+
+ private:
+  std::string name_;
+  std::vector<std::string> members_;
+  std::vector<char *> mem_;
+  struct group gr_;
+};
+
+// cleared by TurnOffMemoization, once and for all
+std::atomic<bool> memoized{true};
+
+// memoizes lookups of a single database, by name and by id.
+// missing entries are memoized as nullptr.
+//
+// lookups are serialized, getpwnam & co. aren't reentrant anyway.
+template <typename Entry>
+class Memo {
+ public:
+  typedef typename Entry::Raw Raw;
+  typedef typename Entry::Id Id;
+
+  Memo(const char *db, const Raw *(*by_name)(const char *),
+       const Raw *(*by_id)(Id))
+      : db_{db}, by_name_{by_name}, by_id_{by_id} {}
+
+  const Raw *Get(const std::string &name) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = names_.find(name);
+    if (memoized && it != names_.end()) {
+      Hit(name);
+      return it->second == nullptr ? nullptr : it->second->Get();
+    }
+
+    Miss(name);
+    int64_t start{recorder::Now()};
+    const Raw *raw{by_name_(name.c_str())};
+    recorder::Record(recorder::NSS, db_, name.c_str(),
+                     raw == nullptr ? -1
+                                    : static_cast<int64_t>(Entry::IdOf(*raw)),
+                     recorder::Now() - start);
+    if (!memoized) {
+      return Fresh(raw);
+    }
+    const Entry *entry{Add(raw)};
+    names_[name] = entry;
+    return entry == nullptr ? nullptr : entry->Get();
+  }
+
+  const Raw *Get(Id id) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = ids_.find(id);
+    if (memoized && it != ids_.end()) {
+      Hit(id);
+      return it->second == nullptr ? nullptr : it->second->Get();
+    }
+
+    Miss(id);
+    int64_t start{recorder::Now()};
+    const Raw *raw{by_id_(id)};
+    recorder::Record(recorder::NSS, db_,
+                     raw == nullptr ? "-" : Entry::NameOf(*raw), id,
+                     recorder::Now() - start);
+    if (!memoized) {
+      return Fresh(raw);
+    }
+    const Entry *entry{Add(raw)};
+    ids_[id] = entry;
+    return entry == nullptr ? nullptr : entry->Get();
+  }
+
+ private:
+  // a copy that isn't memoized. it's valid until the thread's next lookup
+  // of the same database.
+  static const Raw *Fresh(const Raw *raw) {
+    static thread_local std::unique_ptr<Entry> entry;
+    entry.reset();
+    if (raw == nullptr) {
+      return nullptr;
+    }
+    entry = std::make_unique<Entry>(*raw);
+    return entry->Get();
+  }
+
+  const Entry *Add(const Raw *raw) {
+    if (raw == nullptr) {
+      return nullptr;
+    }
+
+    // the entry might have already been found the other way around
+    auto it = ids_.find(Entry::IdOf(*raw));
+    if (it != ids_.end() && it->second != nullptr) {
+      return it->second;
+    }
+
+    entries_.emplace_back(*raw);
+    const Entry *entry{&entries_.back()};
+    ids_[Entry::IdOf(*raw)] = entry;
+    names_[Entry::NameOf(*raw)] = entry;
+    return entry;
+  }
+
+  template <typename Key>
+  void Hit(const Key &key) {
+    hits_++;
+    LOG(debug) << "nss: " << db_ << " '" << key << "' memoized (" << hits_
+               << " hits, " << misses_ << " lookups)" << std::endl;
+  }
+
+  template <typename Key>
+  void Miss(const Key &key) {
+    misses_++;
+    LOG(debug) << "nss: looking up " << db_ << " '" << key << "'" << std::endl;
+  }
+
+  std::mutex mutex_;
+  const char *db_;
+  const Raw *(*by_name_)(const char *);
+  const Raw *(*by_id_)(Id);
+  std::deque<Entry> entries_;
+  std::unordered_map<std::string, const Entry *> names_;
+  std::unordered_map<Id, const Entry *> ids_;
+  int hits_{0};
+  int misses_{0};
+};
+
+using suex::permissions::IdentitySnapshot;
+
+// the snapshot holds only what the configuration names, anything else
+// is looked up in NSS. it's trusted for as long as the lookups are
+// memoized, so it isn't consulted once they're not.
+
+const IdentitySnapshot *Snapshot() {
+  return memoized ? &IdentitySnapshot::Current() : nullptr;
+}
+
+const struct passwd *LookupPasswd(const char *name) {
+  const struct passwd *pw{Snapshot() ? Snapshot()->GetPasswd(name) : nullptr};
+  return pw != nullptr ? pw : getpwnam(name);
+}
+
+const struct passwd *LookupPasswd(uid_t uid) {
+  const struct passwd *pw{Snapshot() ? Snapshot()->GetPasswd(uid) : nullptr};
+  return pw != nullptr ? pw : getpwuid(uid);
+}
+
+const struct group *LookupGroup(const char *name) {
+  const struct group *gr{Snapshot() ? Snapshot()->GetGroup(name) : nullptr};
+  return gr != nullptr ? gr : getgrnam(name);
+}
+
+const struct group *LookupGroup(gid_t gid) {
+  const struct group *gr{Snapshot() ? Snapshot()->GetGroup(gid) : nullptr};
+  return gr != nullptr ? gr : getgrgid(gid);
+}
+
+Memo<PasswdEntry> &Passwd() {
+  static Memo<PasswdEntry> memo{"passwd", LookupPasswd, LookupPasswd};
+  return memo;
+}
+
+Memo<GroupEntry> &Groups() {
+  static Memo<GroupEntry> memo{"group", LookupGroup, LookupGroup};
+  return memo;
+}
+
+const struct passwd *suex::nss::GetPasswd(const std::string &name) {
+  return Passwd().Get(name);
+}
+
+const struct passwd *suex::nss::GetPasswd(uid_t uid) {
+  return Passwd().Get(uid);
+}
+
+const struct group *suex::nss::GetGroup(const std::string &name) {
+  return Groups().Get(name);
+}
+
+const struct group *suex::nss::GetGroup(gid_t gid) {
+  return Groups().Get(gid);
+}
+
+const std::vector<gid_t> &suex::nss::GetGroupList(const std::string &user,
+                                                  gid_t gid) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::vector<gid_t>> memo;
+  std::lock_guard<std::mutex> lock{mutex};
+  auto it = memo.find(user);
+  if (memoized && it != memo.end()) {
+    LOG(debug) << "nss: group list of '" << user << "' memoized" << std::endl;
+    return it->second;
+  }
+
+  LOG(debug) << "nss: looking up group list of '" << user << "'" << std::endl;
+  // never taken from the snapshot: a user removed from a group (i.e wheel)
+  // loses it as soon as NSS does
+  std::vector<gid_t> groups;
+  {
+    recorder::Span span{recorder::NSS, "grouplist", user.c_str()};
+    groups = QueryGroupList(user, gid);
+    span.Value(static_cast<int64_t>(groups.size()));
+  }
+
+  // valid until the thread's next lookup, like the entries
+  if (!memoized) {
+    static thread_local std::vector<gid_t> fresh;
+    return fresh = std::move(groups);
+  }
+  return memo[user] = std::move(groups);
+}
+
+void suex::nss::TurnOffMemoization() {
+  LOG(debug) << "nss: lookups aren't memoized from now on" << std::endl;
+  memoized = false;
+}
+
+std::vector<gid_t> suex::nss::QueryGroupList(const std::string &user,
+                                             gid_t gid) {
+  // walk through all the groups that a user has
+  int ngroups = 0;
+  std::vector<gid_t> groupvec{};
+
+  while (true) {
+    if (getgrouplist(user.c_str(), gid, groupvec.data(), &ngroups) < 0) {
+      groupvec.resize(static_cast<uint64_t>(ngroups));
+      continue;
+    }
+    groupvec.resize(static_cast<uint64_t>(ngroups));
+    return groupvec;
+  }
+}
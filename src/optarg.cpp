@@ -50,7 +50,7 @@ int OptArgs::ParseOpts(int argc, char *argv[]) {
   int c;
   argc = GetArgumentCount(argc, argv);
   while (true) {
-    c = getopt(argc, argv, "a:C:EVlvznsu:");
+    c = getopt(argc, argv, "a:C:EVRAlvznsu:");
     if (c == -1) {
       return optind;
     }
@@ -89,6 +89,14 @@ int OptArgs::ParseOpts(int argc, char *argv[]) {
         verbose_mode_ = true;
         break;
       }
+      case 'R': {
+        rebuild_identities_ = true;
+        break;
+      }
+      case 'A': {
+        show_audit_ = true;
+        break;
+      }
       case 'v': {
         show_version_ = true;
         break;
@@ -1,14 +1,18 @@
+#include <algorithm>
 #include <exceptions.hpp>
 #include <logger.hpp>
+#include <nss.hpp>
 #include <sstream>
 
+using suex::permissions::Arena;
 using suex::permissions::Entity;
 using suex::permissions::Group;
 using suex::permissions::User;
 
 std::ostream &permissions::operator<<(std::ostream &os, const Entity &entity) {
-  os << (entity.Deny() ? "deny" : "permit") << " " << entity.Owner().Name()
-     << " as " << entity.AsUser().Name() << " ";
+  os << (entity.Deny() ? "deny" : "permit") << " "
+     << (entity.IsGroup() ? ":" : "") << entity.OwnerName() << " as "
+     << entity.AsUserName() << " ";
 
   std::ostringstream opts_ss;
   opts_ss << (entity.PromptForPassword() ? "" : "nopass ")
@@ -20,41 +24,139 @@ std::ostream &permissions::operator<<(std::ostream &os, const Entity &entity) {
   return os;
 }
 
+Entity::Entity(Arena *arena, const User &user, const User &as_user, bool deny,
+               bool keepenv, bool nopass, bool persist, const Env *env,
+               int lineno, const std::string &cmd_re,
+               const std::string &cmd_glob)
+    : owner_id_{user.Id()},
+      as_id_{as_user.Id()},
+      deny_{deny},
+      nopass_{nopass},
+      keepenv_{keepenv},
+      persist_{persist},
+      lineno_{static_cast<unsigned>(lineno)},
+      owner_name_{arena->Intern(user.Name())},
+      as_name_{arena->Intern(as_user.Name())},
+      cmd_re_{arena->Intern(cmd_re)},
+      cmd_glob_{cmd_glob.empty() ? nullptr : arena->Intern(cmd_glob)},
+      env_{env} {}
+
+Entity::Entity(Arena *arena, const Group &group, const User &as_user,
+               bool deny, bool keepenv, bool nopass, bool persist,
+               const Env *env, int lineno, const std::string &cmd_re,
+               const std::string &cmd_glob)
+    : Entity(arena, User(), as_user, deny, keepenv, nopass, persist, env,
+             lineno, cmd_re, cmd_glob) {
+  group_id_ = group.Id();
+  owner_name_ = arena->Intern(group.Name());
+}
+
+const Entity::EnvToAdd &Entity::EnvVarsToAdd() const {
+  static const EnvToAdd empty{};
+  return env_ == nullptr ? empty : env_->add;
+}
+
 bool Entity::CanExecute(const User &user, const std::string &cmd) const {
-  if (Owner().Id() != RunningUser().Id()) {
+  if (IsGroup() ? !RunningUserInGroup(GroupId())
+                : OwnerId() != RunningUser().Id()) {
     return false;
   }
 
-  if (AsUser().Id() != user.Id()) {
+  if (AsUserId() != user.Id()) {
     return false;
   };
 
-  std::string prefix;
-  DEFER(logger::debug() << prefix << cmd_re << " ~= " << cmd << std::endl);
-  // no need to pre-compile the regular expression
-  // it's evaluated only once during execution
-  if (re2::RE2::FullMatch(cmd, re2::RE2(cmd_re))) {
-    prefix = "[!] ";
-    return true;
+  bool match{re2::RE2::FullMatch(cmd, CommandRegex())};
+  LOG(debug) << (match ? "[!] " : "") << Command() << " ~= " << cmd
+             << std::endl;
+  return match;
+}
+
+std::shared_ptr<const re2::RE2> permissions::Compile(
+    const std::string &cmd_re) {
+  // group and glob expansion produce lots of entities with the same cmd_re,
+  // compile each one of them once, and share it between all the entities.
+  static std::unordered_map<std::string, std::weak_ptr<const re2::RE2>> rxs;
+  // the size of rxs after it was last pruned
+  static size_t pruned_size{0};
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock{mutex};
+
+  auto it = rxs.find(cmd_re);
+  if (it != rxs.end()) {
+    if (auto rx = it->second.lock()) {
+      return rx;
+    }
   }
 
-  return false;
+  // the regexes of freed entities (i.e of previous loads) expire, drop them
+  // once rxs doubled, so inserting stays amortized O(1)
+  if (it == rxs.end() && rxs.size() >= 2 * std::max<size_t>(pruned_size, 64)) {
+    for (auto rx_it = rxs.begin(); rx_it != rxs.end();) {
+      rx_it = rx_it->second.expired() ? rxs.erase(rx_it) : std::next(rx_it);
+    }
+    pruned_size = rxs.size();
+  }
+
+  auto rx = std::make_shared<const re2::RE2>(cmd_re);
+  rxs[cmd_re] = rx;
+  return rx;
 }
 
-int setgroups(const User &user) {
-  // walk through all the groups that a user has and set them
-  int ngroups = 0;
-  const char *name = user.Name().c_str();
-  std::vector<gid_t> groupvec{};
-
-  while (true) {
-    if (getgrouplist(name, static_cast<gid_t>(user.GroupId()),
-                     &groupvec.front(), &ngroups) < 0) {
-      groupvec.resize(static_cast<uint64_t>(ngroups));
-      continue;
+const re2::RE2 &Entity::CommandRegex() const {
+  // entities are matched concurrently, the first regex that's stored wins
+  std::shared_ptr<const re2::RE2> rx{std::atomic_load(&cmd_rx_)};
+  if (rx == nullptr) {
+    rx = Compile(Command());
+    std::shared_ptr<const re2::RE2> none;
+    if (!std::atomic_compare_exchange_strong(&cmd_rx_, &none, rx)) {
+      rx = none;
     }
-    return setgroups(static_cast<size_t>(ngroups), &groupvec.front());
   }
+  return *rx;
+}
+
+std::string Entity::ResolveCommand(const std::string &exe) const {
+  return exe + Command().substr(CommandGlob().size());
+}
+
+Entity Entity::Resolve(Arena *arena, const std::string &exe) const {
+  Entity e{*this};
+  e.cmd_re_ = arena->Intern(ResolveCommand(exe));
+  e.cmd_glob_ = nullptr;
+  e.cmd_rx_.reset();
+  return e;
+}
+
+const std::string *Arena::Intern(const std::string &str) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto it = strings_.find(str);
+  if (it == strings_.end()) {
+    it = strings_.emplace(str).first;
+  }
+  return &*it;
+}
+
+const Entity::Env *Arena::Add(Entity::Env env) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  envs_.emplace_back(std::move(env));
+  return &envs_.back();
+}
+
+void Arena::Clear() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  strings_.clear();
+  envs_.clear();
+}
+
+std::vector<gid_t> permissions::GetGroups(const User &user) {
+  return nss::GetGroupList(user.Name(), static_cast<gid_t>(user.GroupId()));
+}
+
+int setgroups(const User &user) {
+  // set all the groups that a user has
+  std::vector<gid_t> groupvec{permissions::GetGroups(user)};
+  return setgroups(groupvec.size(), groupvec.data());
 }
 
 void permissions::Set(const User &user) {
@@ -82,7 +184,7 @@ void User::Initialize(const struct passwd *pw) {
 }
 
 User::User(uid_t uid) : uid_{-1} {
-  struct passwd *pw = getpwuid(uid);
+  const struct passwd *pw = nss::GetPasswd(uid);
   if (pw == nullptr) {
     return;
   }
@@ -96,12 +198,13 @@ User::User(const std::string &user) : name_{user}, uid_{-1} {
 
   // if both fail, also try to load the user as a uid.
   const struct passwd *pw =
-      user.empty() ? getpwuid(static_cast<uid_t>(RunningUser().Id()))
-                   : getpwnam(user.c_str());
+      user.empty() ? nss::GetPasswd(static_cast<uid_t>(RunningUser().Id()))
+                   : nss::GetPasswd(user);
 
   if (pw == nullptr) {
     try {
-      pw = getpwuid(static_cast<uid_t>(std::stol(user, nullptr, 10)));
+      pw = nss::GetPasswd(
+          static_cast<uid_t>(std::stol(user, nullptr, 10)));
 
     } catch (std::invalid_argument &) {
       // the user string is not a number
@@ -135,15 +238,16 @@ bool User::operator<=(const User &other) const { return !(other < *this); }
 
 bool User::operator>=(const User &other) const { return !(*this < other); }
 
-Group::Group(gid_t gid) : gid_{-1} {
-  struct group *gr = getgrgid(gid);
+Group::Group(gid_t gid, bool resolve_members) : gid_{-1} {
+  const struct group *gr = nss::GetGroup(gid);
   if (gr == nullptr) {
     return;
   }
-  Initialize(gr);
+  Initialize(gr, resolve_members);
 }
 
-Group::Group(const std::string &grp) : name_{grp}, gid_{-1} {
+Group::Group(const std::string &grp, bool resolve_members)
+    : name_{grp}, gid_{-1} {
   // try to extract the group struct
   // if the group is empty, and the user exists -> use the user's group,
   //
@@ -154,10 +258,11 @@ Group::Group(const std::string &grp) : name_{grp}, gid_{-1} {
     return;
   }
 
-  struct group *gr = getgrnam(grp.c_str());
+  const struct group *gr = nss::GetGroup(grp);
   if (gr == nullptr) {
     try {
-      gr = getgrgid(static_cast<gid_t>(std::stol(grp, nullptr, 10)));
+      gr = nss::GetGroup(
+          static_cast<gid_t>(std::stol(grp, nullptr, 10)));
 
     } catch (std::invalid_argument &) {
       // the group string is not a number
@@ -168,7 +273,7 @@ Group::Group(const std::string &grp) : name_{grp}, gid_{-1} {
     }
   }
 
-  Initialize(gr);
+  Initialize(gr, resolve_members);
 }
 
 bool Group::operator==(const Group &other) const { return gid_ == other.gid_; }
@@ -184,10 +289,14 @@ bool Group::operator>(const Group &other) const { return other < *this; }
 bool Group::operator<=(const Group &other) const { return !(other < *this); }
 bool Group::operator>=(const Group &other) const { return !(*this < other); }
 
-void Group::Initialize(const struct group *gr) {
+void Group::Initialize(const struct group *gr, bool resolve_members) {
   gid_ = gr->gr_gid;
   name_ = std::string(gr->gr_name);
 
+  if (!resolve_members) {
+    return;
+  }
+
   if (RunningUser().GroupId() == gid_) {
     members_.emplace(RunningUser());
   }
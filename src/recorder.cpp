@@ -0,0 +1,246 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+#include <recorder.hpp>
+
+using suex::recorder::Type;
+
+// 128 bytes, so the whole ring is 64KB
+struct event_t {
+  int64_t start;
+  int64_t duration;
+  int64_t value;
+  Type type;
+  char text[103];
+};
+
+// zero initialized, nothing is allocated when recording
+event_t events[RECORDER_EVENTS];
+std::atomic<uint64_t> recorded{0};
+std::atomic<bool> enabled{false};
+// guards events. it's a spin lock rather than a mutex, because it's taken
+// in signal handlers. it's held only while an event is copied, or the ring
+// is dumped.
+std::atomic_flag busy = ATOMIC_FLAG_INIT;
+// set once a fatal signal is handled. the thread that crashed might hold
+// busy, so it's no longer waited for indefinitely.
+std::atomic<bool> crashing{false};
+const int64_t started{suex::recorder::Now()};
+
+// how many times busy is tried once crashing, before giving up on it
+#define CRASH_LOCK_ATTEMPTS (1 << 20)
+
+bool Lock() {
+  for (uint64_t i = 1; busy.test_and_set(std::memory_order_acquire); i++) {
+    if (crashing && i >= CRASH_LOCK_ATTEMPTS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Unlock() { busy.clear(std::memory_order_release); }
+
+void suex::recorder::Enable() { enabled = true; }
+
+int64_t suex::recorder::Now() {
+  timespec ts{0, 0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// copies src after dst[pos], and returns the position after it
+size_t Copy(char *dst, size_t size, size_t pos, const char *src) {
+  for (; pos < size - 1 && *src != '\0'; pos++, src++) {
+    dst[pos] = *src;
+  }
+  dst[pos] = '\0';
+  return pos;
+}
+
+void suex::recorder::Record(Type type, const char *what, const char *detail,
+                            int64_t value, int64_t duration) {
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  int64_t end{Now()};
+  if (!Lock()) {
+    return;
+  }
+  uint64_t idx{recorded.fetch_add(1, std::memory_order_relaxed)};
+  event_t &e = events[idx % RECORDER_EVENTS];
+  e.start = end - duration;
+  e.duration = duration;
+  e.value = value;
+  e.type = type;
+  size_t pos{Copy(e.text, sizeof(e.text), 0, what)};
+  if (*detail != '\0') {
+    pos = Copy(e.text, sizeof(e.text), pos, " ");
+    Copy(e.text, sizeof(e.text), pos, detail);
+  }
+  Unlock();
+}
+
+// formats a line without allocating, printf isn't async signal safe
+class Line {
+ public:
+  Line &operator<<(const char *txt) {
+    len_ = Copy(buf_, sizeof(buf_), len_, txt);
+    return *this;
+  }
+
+  Line &operator<<(int64_t num) {
+    char digits[24];
+    size_t n{0};
+    uint64_t abs = num < 0 ? -static_cast<uint64_t>(num) : num;
+    do {
+      digits[n++] = static_cast<char>('0' + abs % 10);
+      abs /= 10;
+    } while (abs > 0);
+    if (num < 0) {
+      digits[n++] = '-';
+    }
+    while (n > 0 && len_ < sizeof(buf_) - 1) {
+      buf_[len_++] = digits[--n];
+    }
+    buf_[len_] = '\0';
+    return *this;
+  }
+
+  // nanoseconds, as milliseconds with 3 decimal places, padded to width
+  Line &Millis(int64_t ns, int width = 0) {
+    int64_t us{ns / 1000};
+    for (int64_t ms = us / 1000; ms >= 10; ms /= 10) {
+      width--;
+    }
+    for (; width > 1; width--) {
+      *this << " ";
+    }
+    *this << us / 1000 << ".";
+    for (int64_t div = 100; div > 0; div /= 10) {
+      *this << (us % 1000) / div % 10;
+    }
+    return *this << "ms";
+  }
+
+  const char *Text() const { return buf_; }
+
+  void Write(int fd) {
+    *this << "\n";
+    if (write(fd, buf_, len_) < 0) {
+      return;
+    }
+  }
+
+ private:
+  char buf_[256]{};
+  size_t len_{0};
+};
+
+const char *TypeName(Type type) {
+  switch (type) {
+    case suex::recorder::PHASE:
+      return "phase ";
+    case suex::recorder::RULE:
+      return "rule  ";
+    case suex::recorder::NSS:
+      return "nss   ";
+    case suex::recorder::PAM:
+      return "pam   ";
+    case suex::recorder::ERROR:
+      return "error ";
+  }
+  return "?     ";
+}
+
+void suex::recorder::Dump(int fd) {
+  // a dump without the lock might see a torn event, which is better than
+  // no dump at all
+  bool locked{Lock()};
+  uint64_t end{recorded.load()};
+  uint64_t begin{end > RECORDER_EVENTS ? end - RECORDER_EVENTS : 0};
+  Line header;
+  header << "suex flight recorder (pid " << static_cast<int64_t>(getpid())
+         << "): " << static_cast<int64_t>(end - begin) << " of "
+         << static_cast<int64_t>(end) << " events";
+  header.Write(fd);
+
+  for (uint64_t i = begin; i < end; i++) {
+    const event_t &e = events[i % RECORDER_EVENTS];
+    Line line;
+    line << "+";
+    line.Millis(e.start - started, 4) << " " << TypeName(e.type) << e.text;
+    if (e.type != PHASE) {
+      line << " = " << e.value;
+    }
+    if (e.duration > 0) {
+      line << " (";
+      line.Millis(e.duration) << ")";
+    }
+    line.Write(fd);
+  }
+  if (locked) {
+    Unlock();
+  }
+}
+
+bool suex::recorder::DumpToFile() {
+  // the caller can crash suex over & over, so the dumps are capped: a slot
+  // is taken only if it doesn't exist yet (O_EXCL), and never rewritten.
+  Line path;
+  int fd{-1};
+  for (int64_t slot = 0; fd < 0 && slot < RECORDER_DUMPS; slot++) {
+    path = Line{};
+    path << PATH_RECORDER_DUMP << slot;
+    fd = open(path.Text(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+              S_IRUSR);
+    if (fd < 0 && errno != EEXIST) {
+      return false;
+    }
+  }
+  if (fd < 0) {
+    return false;
+  }
+  Dump(fd);
+  close(fd);
+
+  Line notice;
+  notice << "flight recorder dumped to " << path.Text();
+  notice.Write(STDERR_FILENO);
+  return true;
+}
+
+// the handlers that were installed before, by signal
+struct sigaction previous[NSIG];
+
+void OnSignal(int signo, siginfo_t *info, void *ctx) {
+  crashing = true;
+  suex::recorder::Record(suex::recorder::ERROR, "fatal signal", "", signo);
+  suex::recorder::DumpToFile();
+
+  const struct sigaction &prev = previous[signo];
+  if ((prev.sa_flags & SA_SIGINFO) != 0) {
+    prev.sa_sigaction(signo, info, ctx);
+  } else if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+    prev.sa_handler(signo);
+  }
+
+  // the handler is reset, so this terminates the process
+  raise(signo);
+}
+
+void suex::recorder::HandleSignals() {
+  for (int signo : {SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV}) {
+    struct sigaction action {};
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER | SA_RESETHAND;
+    sigfillset(&action.sa_mask);
+    sigdelset(&action.sa_mask, signo);
+    action.sa_sigaction = &OnSignal;
+    sigaction(signo, &action, &previous[signo]);
+  }
+}
@@ -0,0 +1,185 @@
+#include <cctype>
+#include <exceptions.hpp>
+#include <logger.hpp>
+#include <rule.hpp>
+#include <vector>
+
+using re2::StringPiece;
+using suex::permissions::rule_t;
+
+// same as \s in RE2
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+size_t SkipSpaces(const StringPiece &txt, size_t pos) {
+  while (pos < txt.size() && IsSpace(txt[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+// extracts the token that starts at pos, and returns the position after it
+size_t NextToken(const StringPiece &txt, size_t pos, StringPiece *token) {
+  size_t end = pos;
+  while (end < txt.size() && !IsSpace(txt[end])) {
+    end++;
+  }
+  *token = txt.substr(pos, end - pos);
+  return end;
+}
+
+// [a-z_][a-z0-9_-]*[$]?
+bool IsUserName(StringPiece name) {
+  if (!name.empty() && name[name.size() - 1] == '$') {
+    name.remove_suffix(1);
+  }
+
+  // the ctype functions take an unsigned char, other bytes are undefined
+  if (name.empty() ||
+      !(std::islower(static_cast<unsigned char>(name[0])) || name[0] == '_')) {
+    return false;
+  }
+
+  for (unsigned char c : name) {
+    if (!(std::islower(c) || std::isdigit(c) || c == '_' || c == '-')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// [\t|\s]*
+bool IsBlank(const StringPiece &line, size_t *pos) {
+  while (*pos < line.size() && (line[*pos] == '|' || IsSpace(line[*pos]))) {
+    (*pos)++;
+  }
+  return *pos == line.size();
+}
+
+// [:]user as user cmd command [args args], starting at the token first.
+// only these tokens are looked at, so each candidate is checked in constant
+// time (besides the user names).
+bool TokenizeSubjects(const std::vector<StringPiece> &tokens, size_t first,
+                      rule_t *rule) {
+  size_t count = tokens.size() - first;
+  if (count != 5 && !(count > 6 && tokens[first + 5] == "args")) {
+    return false;
+  }
+
+  rule->user = tokens[first];
+  StringPiece user{rule->user};
+  if (!user.empty() && user[0] == ':') {
+    user.remove_prefix(1);
+  }
+  if (!IsUserName(user) || tokens[first + 1] != "as") {
+    return false;
+  }
+
+  rule->as = tokens[first + 2];
+  if (!IsUserName(rule->as) || tokens[first + 3] != "cmd") {
+    return false;
+  }
+
+  rule->cmd = tokens[first + 4];
+  rule->args = StringPiece{};
+  if (count == 5) {
+    return true;
+  }
+
+  // the arguments span until the last non whitespace character,
+  // and are at least two characters long.
+  const char *begin = tokens[first + 6].data();
+  const char *end = tokens.back().data() + tokens.back().size();
+  if (end < begin + 2) {
+    return false;
+  }
+
+  rule->args = StringPiece{begin, static_cast<size_t>(end - begin)};
+  return true;
+}
+
+// (nopass|persist|keepenv|setenv\s\{.*\})
+void TokenizeOptions(const StringPiece &options, rule_t *rule) {
+  for (size_t pos = 0; pos < options.size();) {
+    StringPiece rest{options.substr(pos)};
+    if (rest.starts_with("nopass")) {
+      rule->nopass = true;
+      pos += 6;
+      continue;
+    }
+    if (rest.starts_with("persist")) {
+      rule->persist = true;
+      pos += 7;
+      continue;
+    }
+    if (rest.starts_with("keepenv")) {
+      rule->keepenv = true;
+      pos += 7;
+      continue;
+    }
+    if (rest.starts_with("setenv") && rest.size() > 7 && IsSpace(rest[6]) &&
+        rest[7] == '{') {
+      // the last closing brace
+      size_t close = rest.size();
+      while (close > 8 && rest[close - 1] != '}') {
+        close--;
+      }
+      if (close > 8) {
+        rule->env = rest.substr(0, close);
+        pos += close;
+        continue;
+      }
+    }
+    pos++;
+  }
+}
+
+bool permissions::Tokenize(StringPiece line, int lineno, rule_t *rule) {
+  LOG(debug) << "parsing line " << lineno << ": '" << line << "'" << std::endl;
+
+  size_t pos{0};
+  //  an empty line, no need to parse
+  if (IsBlank(line, &pos)) {
+    LOG(debug) << "line " << lineno << " is empty, skipping." << std::endl;
+    return false;
+  }
+
+  //  a comment, no need to parse
+  if (line[pos] == '#') {
+    LOG(debug) << "line " << lineno << " is a comment, skipping." << std::endl;
+    return false;
+  }
+
+  *rule = rule_t{};
+  rule->lineno = lineno;
+
+  StringPiece type;
+  pos = NextToken(line, 0, &type);
+  if ((type == "permit" || type == "deny") && pos < line.size()) {
+    rule->deny = type == "deny";
+    StringPiece rest{line.substr(SkipSpaces(line, pos))};
+
+    // the line is split once, and the subjects are looked for from the end:
+    // options are optional, and may contain anything. like the original
+    // regex, take the longest options that leave a valid line behind.
+    std::vector<StringPiece> tokens;
+    for (size_t next = 0; next < rest.size();) {
+      tokens.emplace_back();
+      next = SkipSpaces(rest, NextToken(rest, next, &tokens.back()));
+    }
+
+    for (size_t first = tokens.size(); first-- > 0;) {
+      if (TokenizeSubjects(tokens, first, rule)) {
+        TokenizeOptions(
+            rest.substr(0, static_cast<size_t>(tokens[first].data() -
+                                               rest.data())),
+            rule);
+        return true;
+      }
+    }
+  }
+
+  LOG(debug) << "couldn't parse: " << line << std::endl;
+  throw suex::ConfigError("line is invalid: '%s'", line.as_string().c_str());
+}
@@ -0,0 +1,31 @@
+#include <logger.hpp>
+#include <snapshot.hpp>
+
+using suex::permissions::Permissions;
+using suex::permissions::Snapshot;
+using suex::permissions::Snapshots;
+
+Snapshots::Snapshots(std::string path, std::string auth_style, LoadMode mode)
+    : path_{std::move(path)}, auth_style_{std::move(auth_style)}, mode_{mode} {
+  Reload();
+}
+
+Snapshot Snapshots::Reload() {
+  std::lock_guard<std::mutex> lock{reload_mutex_};
+
+  // the snapshot owns the descriptor, which f gives up
+  file::File f{path_, O_RDONLY | O_CLOEXEC};
+  auto perms = std::make_shared<Permissions>(f, auth_style_);
+  f.Invalidate();
+  perms->Load(mode_);
+  if (!perms->Error().empty()) {
+    throw suex::ConfigError("%s", perms->Error().c_str());
+  }
+
+  Snapshot snapshot{std::move(perms)};
+  std::atomic_store(&current_, snapshot);
+  uint64_t generation{generation_.fetch_add(1, std::memory_order_release) + 1};
+  LOG(info) << "published generation " << generation << " of " << path_
+            << ", " << snapshot->Size() << " permissions" << std::endl;
+  return snapshot;
+}
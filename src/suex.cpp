@@ -1,14 +1,18 @@
 #include <actions.hpp>
+#include <audit.hpp>
 #include <auth.hpp>
+#include <broker.hpp>
 #include <backward-cpp/backward.hpp>
 #include <logger.hpp>
+#include <recorder.hpp>
+#include <timings.hpp>
 #include <version.hpp>
 
 using suex::optargs::OptArgs;
 using suex::permissions::Permissions;
 
 void ShowUsage() {
-  std::cout << "usage: suex [-LEVzvns] [-a style] [-C config] [-u user] "
+  std::cout << "usage: suex [-LEVRAzvns] [-a style] [-C config] [-u user] "
                "command [args]"
             << std::endl;
 }
@@ -39,72 +43,116 @@ void CreateRuntimeDirectories() {
   }
 }
 
-char *const *GetEnv(std::vector<char *> *vec, const permissions::Entity &entity,
-                    char *environ[]) {
-  if (!entity.EnvironmentVariablesConfigured()) {
-    return environ;
+char *const *GetEnv(std::vector<char *> *vec,
+                    const permissions::Entity &perm) {
+  auto envp = env::Raw();
+  if (!perm.KeepEnvironment()) {
+    // NOT deleting since environment is global and should exist
+    // as long as the app is running
+    envp = new char *[9]{
+        env::GetRaw("DISPLAY"), env::GetRaw("HOME"),     env::GetRaw("LOGNAME"),
+        env::GetRaw("MAIL"),    env::GetRaw("PATH"),     env::GetRaw("TERM"),
+        env::GetRaw("USER"),    env::GetRaw("USERNAME"), nullptr};
   }
 
-  for (int i = 0; environ[i] != nullptr; i++) {
-    auto ev = env::SplitRaw(environ[i]);
-
-    if (entity.ShouldRemoveEnvVar(ev.first)) {
-      continue;
-    }
+  auto env = suex::GetEnv(vec, perm, envp);
+  timings::Mark("env");
+  return env;
+}
 
-    if (entity.ShouldAddEnvVar(ev.first)) {
-      continue;
+// the policy, loaded on demand. executing as root or as yourself, and -v,
+// don't consult it, so they never open the configuration.
+class Policy {
+ public:
+  explicit Policy(const OptArgs &opts) : opts_(opts) {}
+
+  Policy(const Policy &) = delete;
+
+  void operator=(const Policy &) = delete;
+
+  // the configuration can be edited even if it's invalid
+  const Permissions &Load() {
+    if (permissions_ == nullptr) {
+      // listing shows every rule, executing only needs the relevant ones
+      auto mode =
+          opts_.ListPermissions() ? permissions::FULL : permissions::LAZY;
+      permissions_ =
+          std::make_unique<Permissions>(PATH_CONFIG, opts_.AuthStyle());
+      permissions_->Load(mode);
+      timings::Mark("load");
     }
-
-    vec->emplace_back(env::ToRaw(ev.first, ev.second));
+    return *permissions_;
   }
 
-  for (const auto &ev : entity.EnvVarsToAdd()) {
-    vec->emplace_back(env::ToRaw(ev.first, ev.second));
+  // LAZY loads only the rules of the running user, so a caller without any
+  // is denied like a caller whose rules don't match, unless the
+  // configuration has no rules at all
+  const Permissions &Valid() {
+    if (Load().Empty() &&
+        (!permissions_->Error().empty() || permissions_->Rules() == 0)) {
+      std::cerr << "! notice that you're not a member of 'wheel'" << std::endl;
+      throw suex::PermissionError("suex.conf is either invalid or empty");
+    }
+    return *permissions_;
   }
 
-  vec->emplace_back(nullptr);
+ private:
+  const OptArgs &opts_;
+  std::unique_ptr<Permissions> permissions_{};
+};
 
-  return vec->data();
-}
-
-char *const *GetEnv(std::vector<char *> *vec, const Permissions &permissions,
+char *const *GetEnv(std::vector<char *> *vec, Policy *policy,
                     const OptArgs &opts) {
-  auto envp = env::Raw();
-
   if (utils::BypassPermissions(opts.AsUser())) {
-    return envp;
+    audit::Decide(audit::BYPASS, opts.AsUser(), opts.CommandArguments(),
+                  nullptr);
+    return env::Raw();
   }
-  auto perm = Permit(permissions, opts);
-  if (!perm->KeepEnvironment()) {
-    // NOT deleting since environment is global and should exist
-    // as long as the app is running
-    envp = new char *[9]{
-        env::GetRaw("DISPLAY"), env::GetRaw("HOME"),     env::GetRaw("LOGNAME"),
-        env::GetRaw("MAIL"),    env::GetRaw("PATH"),     env::GetRaw("TERM"),
-        env::GetRaw("USER"),    env::GetRaw("USERNAME"), nullptr};
+  auto perm = Permit(policy->Valid(), opts);
+  timings::Mark("permit");
+  return GetEnv(vec, *perm);
+}
+
+// asks suexd whether the command is permitted, and executes it, instead of
+// loading the policy. returns false if suexd isn't running, or it can't
+// decide.
+bool ExecuteBrokered(const OptArgs &opts) {
+  // verbose output shows how the command is matched
+  if (opts.CommandArguments().empty() || opts.VerboseMode() ||
+      opts.EditConfig() || opts.ListPermissions() || opts.ShowVersion() ||
+      opts.Clear() || opts.RebuildIdentities() || opts.ShowAudit() ||
+      !opts.ConfigPath().empty() || utils::BypassPermissions(opts.AsUser())) {
+    return false;
+  }
+
+  permissions::Arena arena;
+  std::unique_ptr<permissions::Entity> perm;
+  if (!broker::Ask(PATH_BROKER_SOCKET, opts.AsUser(), opts.CommandArguments(),
+                   &arena, &perm)) {
+    return false;
   }
+  timings::Mark("load");
+
+  CreateRuntimeDirectories();
+  Permit(perm.get(), opts.AuthStyle(), opts);
+  timings::Mark("permit");
 
-  return GetEnv(vec, *perm, envp);
+  std::vector<char *> environ;
+  SwitchUserAndExecute(opts.AsUser(), opts.CommandArguments(),
+                       GetEnv(&environ, *perm));
+  return true;
 }
 
-int Do(const Permissions &permissions, const OptArgs &opts) {
+int Do(Policy *policy, const OptArgs &opts) {
   CreateRuntimeDirectories();
 
   if (opts.EditConfig()) {
-    EditConfiguration(opts, permissions);
+    EditConfiguration(opts, policy->Load());
     return 0;
   }
 
-  // up to here, we don't check if the file is valid
-  // because the edit config command can edit invalid files
-  if (permissions.Empty()) {
-    std::cerr << "! notice that you're not a member of 'wheel'" << std::endl;
-    throw suex::PermissionError("suex.conf is either invalid or empty");
-  }
-
   if (opts.ListPermissions()) {
-    ShowPermissions(permissions);
+    ShowPermissions(policy->Valid());
     return 0;
   }
 
@@ -114,7 +162,17 @@ int Do(const Permissions &permissions, const OptArgs &opts) {
   }
 
   if (opts.Clear()) {
-    ClearAuthTokens(permissions);
+    ClearAuthTokens(policy->Valid());
+    return 0;
+  }
+
+  if (opts.ShowAudit()) {
+    ShowAuditLog(opts);
+    return 0;
+  }
+
+  if (opts.RebuildIdentities()) {
+    RebuildIdentities(policy->Valid());
     return 0;
   }
 
@@ -130,12 +188,15 @@ int Do(const Permissions &permissions, const OptArgs &opts) {
 
   std::vector<char *> environ;
   SwitchUserAndExecute(opts.AsUser(), opts.CommandArguments(),
-                       GetEnv(&environ, permissions, opts));
+                       GetEnv(&environ, policy, opts));
   return 0;
 }
 
 int main(int argc, char *argv[]) {
   backward::SignalHandling sh;
+  // the recorder is dumped first, and then the stack trace is shown
+  recorder::Enable();
+  recorder::HandleSignals();
 
   try {
     if (static_cast<int>(geteuid()) != RootUser().Id() ||
@@ -146,19 +207,28 @@ int main(int argc, char *argv[]) {
     if (opts.VerboseMode()) {
       TurnOnVerboseOutput();
     }
-    auto permissions{Permissions(PATH_CONFIG, opts.AuthStyle()).Load()};
-    return Do(permissions, opts);
+    DEFER(if (opts.VerboseMode()) { recorder::Dump(STDERR_FILENO); });
+    timings::Mark("options");
+    if (ExecuteBrokered(opts)) {
+      return 0;
+    }
+    Policy policy{opts};
+    return Do(&policy, opts);
   } catch (InvalidUsage &) {
     ShowUsage();
     return 1;
   } catch (SuExError &e) {
+    recorder::Record(recorder::ERROR, e.what());
     std::cerr << e.what() << std::endl;
     return 1;
-  } catch (std::exception &) {
+  } catch (std::exception &e) {
+    recorder::Record(recorder::ERROR, e.what());
+    // privileged users get a stack trace, and the recorder is dumped with it
     if (Permissions::Privileged()) {
       throw;
     }
     std::cerr << "an unhandled error occurred" << std::endl;
+    recorder::DumpToFile();
     return 1;
   }
 }
@@ -0,0 +1,167 @@
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <actions.hpp>
+#include <backward-cpp/backward.hpp>
+#include <broker.hpp>
+#include <logger.hpp>
+#include <nss.hpp>
+#include <recorder.hpp>
+
+using suex::permissions::Permissions;
+
+#define PATH_ETC "/etc"
+// the listening socket is inherited through restarts
+#define LISTEN_FD_ENV "SUEXD_LISTEN_FD"
+
+void ShowUsage() {
+  std::cout << "usage: suexd [-Vv] [-s socket]" << std::endl;
+}
+
+int Listen(const std::string &path) {
+  if (env::Contains(LISTEN_FD_ENV)) {
+    int fd{std::stoi(env::Get(LISTEN_FD_ENV))};
+    unsetenv(LISTEN_FD_ENV);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+  }
+
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw suex::IOError("'%s' is too long for a socket path", path.c_str());
+  }
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  // a socket that was left behind is replaced, anything else is not
+  file::stat_t st{0};
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode) || unlink(path.c_str()) < 0) {
+      throw suex::IOError("'%s' exists, and is not a socket", path.c_str());
+    }
+  }
+
+  int fd{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+  if (fd < 0) {
+    throw suex::IOError("socket failed: %s", std::strerror(errno));
+  }
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      chmod(path.c_str(), 0666) < 0 || listen(fd, SOMAXCONN) < 0) {
+    throw suex::IOError("couldn't listen on '%s': %s", path.c_str(),
+                        std::strerror(errno));
+  }
+  return fd;
+}
+
+// the watch of PATH_ETC, every other watch is of PATH_CONFIG_DIR
+int etc_wd{-1};
+
+// watches the configuration & the local users and groups
+int Watch() {
+  int fd{inotify_init1(IN_CLOEXEC | IN_NONBLOCK)};
+  if (fd < 0) {
+    throw suex::IOError("inotify_init1 failed: %s", std::strerror(errno));
+  }
+
+  uint32_t mask{IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                IN_MOVED_TO | IN_ATTRIB};
+  etc_wd = inotify_add_watch(fd, PATH_ETC, mask);
+  if (etc_wd < 0) {
+    throw suex::IOError("couldn't watch '%s': %s", PATH_ETC,
+                        std::strerror(errno));
+  }
+  // it's watched once it's created, after a restart
+  if (inotify_add_watch(fd, PATH_CONFIG_DIR, mask) < 0 && errno != ENOENT) {
+    throw suex::IOError("couldn't watch '%s': %s", PATH_CONFIG_DIR,
+                        std::strerror(errno));
+  }
+  return fd;
+}
+
+// drains the watch, and returns true if something suexd depends on changed
+bool Changed(int watch_fd) {
+  static const std::set<std::string> watched{"suex.conf", "suex.conf.d",
+                                             "passwd", "group",
+                                             "nsswitch.conf"};
+  bool changed{false};
+  alignas(inotify_event) char buf[4096];
+  ssize_t len;
+  while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+    for (char *pos = buf; pos < buf + len;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(pos);
+      pos += sizeof(inotify_event) + event->len;
+      // every change in PATH_CONFIG_DIR matters
+      changed |= event->wd != etc_wd ||
+                 (event->len > 0 && watched.count(event->name) > 0);
+    }
+  }
+  return changed;
+}
+
+// executes suexd again, so the policy & the users and groups are loaded from
+// scratch. the listening socket is kept, so no connection is refused.
+void Restart(char *argv[], int listen_fd) {
+  LOG(info) << "configuration changed, restarting" << std::endl;
+  fcntl(listen_fd, F_SETFD, 0);
+  setenv(LISTEN_FD_ENV, std::to_string(listen_fd).c_str(), 1);
+  execv("/proc/self/exe", argv);
+  throw suex::IOError("couldn't restart: %s", std::strerror(errno));
+}
+
+int main(int argc, char *argv[]) {
+  backward::SignalHandling sh;
+  recorder::Enable();
+  recorder::HandleSignals();
+
+  try {
+    if (getuid() != 0 || geteuid() != 0) {
+      throw suex::PermissionError("suexd has to run as root");
+    }
+
+    // suexd outlives the users & groups it looks up, so every request looks
+    // up its caller again
+    suex::nss::TurnOffMemoization();
+
+    std::string socket_path{PATH_BROKER_SOCKET};
+    for (int c = getopt(argc, argv, "Vvs:"); c != -1;
+         c = getopt(argc, argv, "Vvs:")) {
+      switch (c) {
+        case 'V': {
+          TurnOnVerboseOutput();
+          break;
+        }
+        case 'v': {
+          ShowVersion();
+          return 0;
+        }
+        case 's': {
+          socket_path = optarg;
+          break;
+        }
+        default: {
+          ShowUsage();
+          return 1;
+        }
+      }
+    }
+
+    int listen_fd{Listen(socket_path)};
+    int watch_fd{Watch()};
+    Permissions permissions{PATH_CONFIG, DEFAULT_AUTH_STYLE};
+    permissions.Load(permissions::SHARED);
+    LOG(info) << "serving " << permissions.Size() << " permissions on "
+              << socket_path << std::endl;
+
+    while (true) {
+      suex::broker::Serve(permissions, listen_fd, watch_fd);
+      if (Changed(watch_fd)) {
+        Restart(argv, listen_fd);
+      }
+    }
+  } catch (SuExError &e) {
+    recorder::Record(recorder::ERROR, e.what());
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
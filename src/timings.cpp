@@ -0,0 +1,65 @@
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <timings.hpp>
+
+using suex::recorder::Now;
+
+#define MAX_PHASES 8
+
+struct phase_t {
+  const char *name;
+  int64_t duration;
+};
+
+// taken while the process is statically initialized, as early as it gets
+const int64_t start{Now()};
+int64_t last{start};
+phase_t phases[MAX_PHASES];
+size_t marked{0};
+
+void suex::timings::Mark(const char *phase) {
+  recorder::Record(recorder::PHASE, phase);
+  int64_t now{Now()};
+  if (marked < MAX_PHASES) {
+    phases[marked++] = phase_t{phase, now - last};
+  }
+  last = now;
+}
+
+int64_t suex::timings::Duration(const char *phase) {
+  for (size_t i = 0; i < marked; i++) {
+    if (std::strcmp(phases[i].name, phase) == 0) {
+      return phases[i].duration;
+    }
+  }
+  return 0;
+}
+
+int64_t suex::timings::Elapsed() { return Now() - start; }
+
+#ifdef SUEX_PHASE_TIMINGS
+void suex::timings::Report() {
+  const char *env{getenv(TIMINGS_FD_ENV)};
+  if (env == nullptr) {
+    return;
+  }
+
+  std::ostringstream ss;
+  ss << "start=" << start;
+  for (size_t i = 0; i < marked; i++) {
+    ss << " " << phases[i].name << "=" << phases[i].duration;
+  }
+  ss << " end=" << Now() << std::endl;
+
+  // a single write, so it's never interleaved. the harness reports missing
+  // timings, there's nothing to do about a failure here.
+  std::string txt{ss.str()};
+  int fd{static_cast<int>(std::strtol(env, nullptr, 10))};
+  if (write(fd, txt.c_str(), txt.size()) < 0) {
+    return;
+  }
+}
+#endif
@@ -16,16 +16,28 @@ std::string utils::CommandArgsText(const std::vector<char *> &cmdargv) {
   return ss.str();
 }
 
+uint64_t utils::Fingerprint(gsl::span<const char> data) {
+  uint64_t hash{0xcbf29ce484222325};
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 bool utils::BypassPermissions(const User &as_user) {
+  return BypassPermissions(RunningUser(), as_user);
+}
+
+bool utils::BypassPermissions(const User &caller, const User &as_user) {
   // if the user / grp is root, just let them run.
-  if (RunningUser().Id() == 0 && RunningUser().GroupId() == 0) {
+  if (caller.Id() == 0 && caller.GroupId() == 0) {
     return true;
   }
 
   // if the user / grp are the same as the running user,
   // just run the app without performing any operations
-  return RunningUser().Id() == as_user.Id() &&
-         RunningUser().GroupId() == as_user.GroupId();
+  return caller.Id() == as_user.Id() && caller.GroupId() == as_user.GroupId();
 }
 
 std::string utils::GetEditor() {
@@ -60,6 +72,20 @@ const suex::permissions::User &RootUser() {
 }
 
 const suex::permissions::Group &WheelGroup() {
-  static const suex::permissions::Group grp{"wheel"};
+  // membership is checked against the running user's groups
+  static const suex::permissions::Group grp{"wheel", false};
   return grp;
 }
+
+const std::vector<gid_t> &RunningUserGroups() {
+  static const std::vector<gid_t> groups{
+      RunningUser().Exists() ? suex::permissions::GetGroups(RunningUser())
+                             : std::vector<gid_t>{}};
+  return groups;
+}
+
+bool RunningUserInGroup(int gid) {
+  const std::vector<gid_t> &groups = RunningUserGroups();
+  return gid != -1 && std::find(groups.begin(), groups.end(),
+                                static_cast<gid_t>(gid)) != groups.end();
+}
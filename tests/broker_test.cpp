@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <broker.hpp>
+#include <cstring>
+#include <tempfile.hpp>
+#include <thread>
+
+using suex::permissions::Arena;
+using suex::permissions::Entity;
+using suex::permissions::Permissions;
+
+// a listening socket at path, as whoever runs it
+int Listen(const std::string &path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int fd{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+  if (fd < 0 ||
+      bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, 1) < 0) {
+    return -1;
+  }
+  return fd;
+}
+
+// a connected socket to path
+int Connect(const std::string &path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int fd{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    return -1;
+  }
+  return fd;
+}
+
+class BrokerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (geteuid() != 0) {
+      GTEST_SKIP() << "suexd is trusted only as root";
+    }
+    ASSERT_EQ(chmod(dir_.Path().c_str(), 0777), 0);
+  }
+
+  void TearDown() override {
+    if (suexd_.joinable()) {
+      EXPECT_EQ(write(stop_[1], "", 1), 1);
+      suexd_.join();
+      close(stop_[0]);
+      close(stop_[1]);
+      close(listen_fd_);
+    }
+  }
+
+  // serves conf on path_ from a thread, until the test ends
+  void Serve(const std::string &conf) {
+    conf_ = std::make_unique<TempFile>(conf);
+    suex::file::File f{conf_->Path(), O_RDONLY | O_CLOEXEC};
+    permissions_ = std::make_unique<Permissions>(f, DEFAULT_AUTH_STYLE);
+    f.Invalidate();
+    permissions_->Load(suex::permissions::SHARED);
+
+    listen_fd_ = Listen(path_);
+    ASSERT_GE(listen_fd_, 0);
+    ASSERT_EQ(pipe2(stop_, O_CLOEXEC), 0);
+    suexd_ = std::thread{[this] {
+      suex::broker::Serve(*permissions_, listen_fd_, stop_[0]);
+    }};
+  }
+
+  bool Ask(std::unique_ptr<Entity> *perm) {
+    std::vector<char *> cmdargv{const_cast<char *>("/bin/true"), nullptr};
+    return suex::broker::Ask(path_, RootUser(), cmdargv, &arena_, perm);
+  }
+
+  TempDir dir_{};
+  std::string path_{dir_.Path() + "/suexd.sock"};
+  Arena arena_{};
+  std::unique_ptr<TempFile> conf_{};
+  std::unique_ptr<Permissions> permissions_{};
+  int listen_fd_{-1};
+  int stop_[2]{-1, -1};
+  std::thread suexd_{};
+};
+
+TEST_F(BrokerTest, AsksSuexd) {
+  Serve("permit nopass root as root cmd /bin/true\n");
+
+  std::unique_ptr<Entity> perm;
+  EXPECT_TRUE(Ask(&perm));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_FALSE(perm->Deny());
+  EXPECT_FALSE(perm->PromptForPassword());
+  EXPECT_EQ(perm->LineNumber(), 1);
+}
+
+// suexd waits for every client at once, so clients that connect and don't
+// send anything don't hold the others back (suex would give up on suexd)
+TEST_F(BrokerTest, AnswersWhileOtherClientsAreIdle) {
+  Serve("permit nopass root as root cmd /bin/true\n");
+  std::vector<int> idle;
+  for (int i = 0; i < 4; i++) {
+    idle.push_back(Connect(path_));
+    ASSERT_GE(idle.back(), 0);
+  }
+
+  std::unique_ptr<Entity> perm;
+  EXPECT_TRUE(Ask(&perm));
+  EXPECT_NE(perm, nullptr);
+  for (int fd : idle) {
+    close(fd);
+  }
+}
+
+// only suexd running as root is asked, whoever else listens on the socket
+TEST_F(BrokerTest, IgnoresSuexdThatIsntRoot) {
+  int ready[2];
+  ASSERT_EQ(pipe2(ready, O_CLOEXEC), 0);
+  pid_t pid{fork()};
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // permits everything
+    int fd{-1};
+    if (setuid(65534) == 0) {
+      fd = Listen(path_);
+    }
+    if (write(ready[1], "", 1) != 1 || fd < 0) {
+      _exit(1);
+    }
+    int client{accept(fd, nullptr, nullptr)};
+    std::string cmd_re{"/bin/true"};
+    suex::broker::reply_t reply{BROKER_MAGIC, suex::broker::PERMIT,
+                                suex::broker::NOPASS, 0, 1};
+    std::string msg{reinterpret_cast<const char *>(&reply), sizeof(reply)};
+    msg.append(cmd_re);
+    send(client, msg.data(), msg.size(), MSG_NOSIGNAL);
+    _exit(0);
+  }
+  close(ready[1]);
+  char c;
+  ASSERT_EQ(read(ready[0], &c, 1), 1);
+  close(ready[0]);
+
+  std::unique_ptr<Entity> perm;
+  EXPECT_FALSE(Ask(&perm));
+  EXPECT_EQ(perm, nullptr);
+
+  int status{0};
+  waitpid(pid, &status, 0);
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
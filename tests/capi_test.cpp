@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <pwd.h>
+#include <suex.h>
+#include <string>
+
+class CApiTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    passwd *pw = getpwnam("nobody");
+    if (pw == nullptr) {
+      GTEST_SKIP() << "there's no nobody user";
+    }
+    nobody_ = pw->pw_uid;
+    std::string conf{
+        "permit nopass nobody as root cmd /bin/true\n"
+        "deny nobody as root cmd /bin/false\n"};
+    policy_ = suex_policy_load_buffer(conf.data(), conf.size());
+    ASSERT_NE(policy_, nullptr) << suex_error();
+  }
+
+  void TearDown() override { suex_policy_free(policy_); }
+
+  suex_result_t Check(uid_t uid, const char *cmd) {
+    const char *argv[]{cmd, nullptr};
+    suex_result_t result{};
+    EXPECT_EQ(suex_policy_check(policy_, uid, 0, argv, &result), 0)
+        << suex_error();
+    return result;
+  }
+
+  uid_t nobody_{0};
+  suex_policy_t *policy_{nullptr};
+};
+
+TEST_F(CApiTest, Permits) {
+  suex_result_t result{Check(nobody_, "/bin/true")};
+  EXPECT_EQ(result.decision, SUEX_PERMIT);
+  EXPECT_EQ(result.lineno, 1);
+  EXPECT_TRUE(result.nopass);
+  ASSERT_NE(result.command, nullptr);
+}
+
+TEST_F(CApiTest, Denies) {
+  suex_result_t result{Check(nobody_, "/bin/false")};
+  EXPECT_EQ(result.decision, SUEX_DENY);
+  EXPECT_EQ(result.lineno, 2);
+}
+
+TEST_F(CApiTest, DoesntMatchOtherCommands) {
+  suex_result_t result{Check(nobody_, "/bin/sh")};
+  EXPECT_EQ(result.decision, SUEX_NO_MATCH);
+  EXPECT_EQ(result.lineno, 0);
+  EXPECT_EQ(result.command, nullptr);
+}
+
+TEST_F(CApiTest, BypassesRoot) {
+  EXPECT_EQ(Check(0, "/bin/sh").decision, SUEX_BYPASS);
+}
+
+TEST(CApiLoadTest, FailsOnAnInvalidPolicy) {
+  std::string conf{"permit nobody as\n"};
+  EXPECT_EQ(suex_policy_load_buffer(conf.data(), conf.size()), nullptr);
+  EXPECT_STRNE(suex_error(), "");
+}
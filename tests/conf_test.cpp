@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <conf.hpp>
+#include <memory>
+#include <tempfile.hpp>
+
+using suex::permissions::Entity;
+using suex::permissions::LoadMode;
+using suex::permissions::Permissions;
+
+std::unique_ptr<Permissions> Open(const TempFile &conf) {
+  suex::file::File f{conf.Path(), O_RDONLY | O_CLOEXEC};
+  auto permissions = std::make_unique<Permissions>(f, DEFAULT_AUTH_STYLE);
+  f.Invalidate();
+  return permissions;
+}
+
+std::unique_ptr<Permissions> Load(const TempFile &conf, LoadMode mode) {
+  auto permissions = Open(conf);
+  permissions->Load(mode);
+  return permissions;
+}
+
+std::vector<char *> Args(const char *cmd) {
+  return {const_cast<char *>(cmd), nullptr};
+}
+
+// lines that didn't change are taken from the previous Revalidate, but they
+// have to report where they are now
+TEST(RevalidateTest, ReportsTheLinesOfMovedRules) {
+  TempFile conf{"permit nopass root as root cmd /bin/true\n"};
+  auto permissions = Open(conf);
+
+  permissions->Revalidate();
+  ASSERT_TRUE(permissions->Error().empty());
+  const Entity *perm =
+      permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_EQ(perm->LineNumber(), 1);
+
+  conf.Write("# moved\npermit nopass root as root cmd /bin/true\n");
+  permissions->Revalidate();
+  ASSERT_TRUE(permissions->Error().empty());
+  perm = permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_EQ(perm->LineNumber(), 2);
+
+  // the same line twice is matched by the latest one
+  conf.Write(
+      "# moved\n"
+      "permit nopass root as root cmd /bin/true\n"
+      "permit nopass root as root cmd /bin/true\n");
+  permissions->Revalidate();
+  ASSERT_TRUE(permissions->Error().empty());
+  perm = permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_EQ(perm->LineNumber(), 3);
+}
+
+// suex -E reports them, without -V
+TEST(RevalidateTest, ReportsEveryInvalidLine) {
+  TempFile conf{
+      "permit root as\n"
+      "permit nopass root as root cmd /bin/true\n"
+      "allow root\n"};
+  auto permissions = Open(conf);
+
+  testing::internal::CaptureStderr();
+  permissions->Revalidate();
+  std::string output{testing::internal::GetCapturedStderr()};
+  EXPECT_NE(output.find("line 1: "), std::string::npos);
+  EXPECT_EQ(output.find("line 2: "), std::string::npos);
+  EXPECT_NE(output.find("line 3: "), std::string::npos);
+  EXPECT_TRUE(permissions->Empty());
+}
+
+// LAZY loads skip the rules of other users, which doesn't make the
+// configuration empty
+TEST(LazyLoadTest, CountsTheRulesItSkips) {
+  TempFile conf{"permit nopass nobody as root cmd /bin/true\n"};
+  auto permissions = Load(conf, suex::permissions::LAZY);
+  EXPECT_TRUE(permissions->Error().empty());
+  EXPECT_EQ(permissions->Rules(), 1u);
+  for (const Entity &e : *permissions) {
+    EXPECT_NE(e.LineNumber(), 1);
+  }
+  // root is still permitted by its implicit rule
+  const Entity *perm =
+      permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_EQ(perm->LineNumber(), 0);
+}
+
+TEST(LazyLoadTest, TellsAnEmptyConfigurationFromAnInvalidOne) {
+  TempFile empty{"# nothing here\n"};
+  auto permissions = Load(empty, suex::permissions::LAZY);
+  EXPECT_TRUE(permissions->Error().empty());
+  EXPECT_EQ(permissions->Rules(), 0u);
+
+  TempFile invalid{"permit nobody as\n"};
+  permissions = Load(invalid, suex::permissions::LAZY);
+  EXPECT_FALSE(permissions->Error().empty());
+  EXPECT_TRUE(permissions->Empty());
+}
+
+// the matchers of a caller are kept by its groups, so a caller that left a
+// group isn't permitted its rules anymore
+TEST(SharedLoadTest, MatchesTheCurrentGroupsOfTheCaller) {
+  TempFile conf{"permit nopass :root as root cmd /bin/true\n"};
+  auto permissions = Load(conf, suex::permissions::SHARED);
+  ASSERT_TRUE(permissions->Error().empty());
+
+  const Entity *perm =
+      permissions->Get(RootUser(), {0}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_EQ(perm->LineNumber(), 1);
+
+  EXPECT_EQ(permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true")),
+            nullptr);
+}
+
+TEST(SharedLoadTest, ResolvesGlobsOnce) {
+  TempFile conf{"permit nopass root as root cmd /bin/tru*\n"};
+  auto permissions = Load(conf, suex::permissions::SHARED);
+  ASSERT_TRUE(permissions->Error().empty());
+
+  const Entity *perm =
+      permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true"));
+  ASSERT_NE(perm, nullptr);
+  EXPECT_FALSE(perm->IsGlob());
+  EXPECT_EQ(perm->Command().rfind("/bin/true", 0), 0u);
+  EXPECT_EQ(permissions->Get(RootUser(), {}, RootUser(), Args("/bin/true")),
+            perm);
+
+  EXPECT_EQ(permissions->Get(RootUser(), {}, RootUser(), Args("/bin/false")),
+            nullptr);
+}
+
+// the executable is up to the caller, so a missing one just isn't matched
+TEST(SharedLoadTest, DoesntMatchGlobsToMissingExecutables) {
+  TempFile conf{"permit nopass root as root cmd /bin/tru*\n"};
+  auto permissions = Load(conf, suex::permissions::SHARED);
+  ASSERT_TRUE(permissions->Error().empty());
+
+  EXPECT_EQ(permissions->Get(RootUser(), {}, RootUser(),
+                             Args("/bin/true-suex-test-missing")),
+            nullptr);
+}
+
+// matchers are kept by the groups of the caller, which are up to the caller
+// (i.e of suexd), so the oldest ones are dropped, and built again if needed
+TEST(SharedLoadTest, MatchesPastTheMatcherCache) {
+  TempFile conf{"permit nopass :root as root cmd /bin/true\n"};
+  auto permissions = Load(conf, suex::permissions::SHARED);
+  ASSERT_TRUE(permissions->Error().empty());
+
+  for (gid_t gid = 0; gid < MATCHER_CACHE_SIZE + 16; gid++) {
+    const Entity *perm =
+        permissions->Get(RootUser(), {0, gid + 1}, RootUser(),
+                         Args("/bin/true"));
+    ASSERT_NE(perm, nullptr);
+    EXPECT_EQ(perm->LineNumber(), 1);
+  }
+  EXPECT_NE(permissions->Get(RootUser(), {0, 1}, RootUser(), Args("/bin/true")),
+            nullptr);
+}
+
+// user names are ascii, other bytes are just invalid
+TEST(LazyLoadTest, RejectsNonAsciiUserNames) {
+  TempFile conf{"permit nopass r\xc3\xb6ot as root cmd /bin/true\n"};
+  auto permissions = Load(conf, suex::permissions::LAZY);
+  EXPECT_FALSE(permissions->Error().empty());
+  EXPECT_TRUE(permissions->Empty());
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <file.hpp>
+#include <tempfile.hpp>
+
+using suex::file::File;
+using suex::file::Mapping;
+using suex::file::stat_t;
+
+std::string Text(const Mapping &mapping) {
+  return std::string{mapping.View().data(),
+                     static_cast<size_t>(mapping.View().size())};
+}
+
+// the identity snapshot is keyed by the device & inode of the configuration,
+// so it has to be built from the generation that was published (see
+// EditConfiguration), not from the file it was published from
+TEST(PublishTest, PublishesANewGeneration) {
+  TempFile edited{"permit root as root\n"};
+  TempFile conf{"deny root as root\n"};
+  File edited_f{edited.Path(), O_RDONLY | O_CLOEXEC};
+  const stat_t before{File{conf.Path(), O_RDONLY | O_CLOEXEC}.Status()};
+
+  edited_f.Publish(conf.Path(), S_IRUSR | S_IRGRP);
+
+  File published{conf.Path(), O_RDONLY | O_CLOEXEC};
+  const stat_t st{published.Status()};
+  EXPECT_EQ(Text(published.Copy()), "permit root as root\n");
+  EXPECT_EQ(st.st_mode & 0777, static_cast<mode_t>(S_IRUSR | S_IRGRP));
+  EXPECT_NE(st.st_ino, before.st_ino);
+  EXPECT_NE(st.st_ino, edited_f.Status().st_ino);
+
+  stat_t path_st{};
+  ASSERT_EQ(stat(conf.Path().c_str(), &path_st), 0);
+  EXPECT_EQ(st.st_dev, path_st.st_dev);
+  EXPECT_EQ(st.st_ino, path_st.st_ino);
+  EXPECT_EQ(st.st_mtim.tv_sec, path_st.st_mtim.tv_sec);
+  EXPECT_EQ(st.st_mtim.tv_nsec, path_st.st_mtim.tv_nsec);
+
+  // nothing is left next to it
+  std::string leftover{conf.Path() + "." + std::to_string(getpid())};
+  EXPECT_NE(access(leftover.c_str(), F_OK), 0);
+}
+
+TEST(PublishTest, KeepsThePreviousGenerationForItsReaders) {
+  TempFile edited{"permit root as root\n"};
+  TempFile conf{"deny root as root\n"};
+  File reader{conf.Path(), O_RDONLY | O_CLOEXEC};
+
+  File{edited.Path(), O_RDONLY | O_CLOEXEC}.Publish(conf.Path(),
+                                                     S_IRUSR | S_IRGRP);
+
+  EXPECT_EQ(Text(reader.Copy()), "deny root as root\n");
+}
+
+TEST(CopyTest, CopiesTheWholeFile) {
+  std::string content;
+  for (int i = 0; i < 10000; i++) {
+    content += "permit root as root cmd /bin/true\n";
+  }
+  TempFile f{content};
+
+  Mapping copy{File{f.Path(), O_RDONLY | O_CLOEXEC}.Copy()};
+  EXPECT_EQ(Text(copy), content);
+
+  // it isn't affected by the file being truncated afterwards
+  f.Write("");
+  EXPECT_EQ(Text(copy), content);
+}
+
+TEST(CopyTest, CopiesAnEmptyFile) {
+  TempFile f{};
+  EXPECT_EQ(File(f.Path(), O_RDONLY | O_CLOEXEC).Copy().View().size(), 0);
+}
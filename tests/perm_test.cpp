@@ -0,0 +1,24 @@
+#include <gtest/gtest.h>
+#include <perm.hpp>
+#include <string>
+
+using suex::permissions::Compile;
+
+TEST(CompileTest, SharesTheRegexesOfTheSameCommand) {
+  auto rx = Compile("/bin/true");
+  EXPECT_EQ(Compile("/bin/true"), rx);
+  EXPECT_NE(Compile("/bin/false"), rx);
+}
+
+// the regexes of freed entities are dropped, and compiled again if needed
+TEST(CompileTest, CompilesExpiredRegexesAgain) {
+  for (int i = 0; i < 1024; i++) {
+    std::string cmd_re{"/bin/tool" + std::to_string(i)};
+    auto rx = Compile(cmd_re);
+    ASSERT_TRUE(rx->ok());
+    EXPECT_EQ(rx->pattern(), cmd_re);
+  }
+  auto rx = Compile("/bin/tool0");
+  EXPECT_EQ(rx->pattern(), "/bin/tool0");
+  EXPECT_EQ(Compile("/bin/tool0"), rx);
+}
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <recorder.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the dump's header, i.e "... (pid 1): 512 of 4000 events"
+std::string DumpHeader() {
+  int fds[2];
+  EXPECT_EQ(pipe(fds), 0);
+  suex::recorder::Dump(fds[1]);
+  close(fds[1]);
+  std::string dump;
+  char buf[4096];
+  for (ssize_t len = read(fds[0], buf, sizeof(buf)); len > 0;
+       len = read(fds[0], buf, sizeof(buf))) {
+    dump.append(buf, static_cast<size_t>(len));
+  }
+  close(fds[0]);
+  return dump.substr(0, dump.find('\n'));
+}
+
+// libsuex never enables it, so the commands its callers check aren't kept.
+// enabling it is for the rest of the process, so it's a single test.
+TEST(RecorderTest, RecordsOnlyOnceEnabled) {
+  suex::recorder::Record(suex::recorder::RULE, "/bin/true");
+  EXPECT_NE(DumpHeader().find(": 0 of 0 events"), std::string::npos);
+
+  suex::recorder::Enable();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([] {
+      for (int j = 0; j < 1000; j++) {
+        suex::recorder::Record(suex::recorder::RULE, "/bin/true", "x", j);
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  std::string expected{": " + std::to_string(RECORDER_EVENTS) + " of 4000"};
+  EXPECT_NE(DumpHeader().find(expected), std::string::npos);
+}
@@ -0,0 +1,49 @@
+#include <dirent.h>
+#include <unistd.h>
+#include <cstring>
+#include <exceptions.hpp>
+#include <fstream>
+#include <tempfile.hpp>
+
+TempFile::TempFile(const std::string &content) {
+  char path[] = "/tmp/suex-test-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    throw suex::IOError("mkstemp() failed: %s", std::strerror(errno));
+  }
+  close(fd);
+  path_ = path;
+  Write(content);
+}
+
+TempFile::~TempFile() { unlink(path_.c_str()); }
+
+void TempFile::Write(const std::string &content) const {
+  std::ofstream out{path_, std::ios::out | std::ios::trunc};
+  out << content;
+  if (!out.flush()) {
+    throw suex::IOError("couldn't write '%s'", path_.c_str());
+  }
+}
+
+TempDir::TempDir() {
+  char path[] = "/tmp/suex-test-XXXXXX";
+  if (mkdtemp(path) == nullptr) {
+    throw suex::IOError("mkdtemp() failed: %s", std::strerror(errno));
+  }
+  path_ = path;
+}
+
+TempDir::~TempDir() {
+  DIR *dir = opendir(path_.c_str());
+  if (dir != nullptr) {
+    for (dirent *ent = readdir(dir); ent != nullptr; ent = readdir(dir)) {
+      std::string name{ent->d_name};
+      if (name != "." && name != "..") {
+        unlink((path_ + "/" + name).c_str());
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(path_.c_str());
+}
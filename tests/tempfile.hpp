@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+// a file under /tmp that's removed when it goes out of scope
+class TempFile {
+ public:
+  explicit TempFile(const std::string &content = "");
+  TempFile(const TempFile &) = delete;
+  ~TempFile();
+  void operator=(const TempFile &) = delete;
+
+  const std::string &Path() const { return path_; }
+
+  // rewrites the file in place, so it keeps its inode
+  void Write(const std::string &content) const;
+
+ private:
+  std::string path_{};
+};
+
+// a directory under /tmp that's removed, with its files, when it goes out of
+// scope
+class TempDir {
+ public:
+  TempDir();
+  TempDir(const TempDir &) = delete;
+  ~TempDir();
+  void operator=(const TempDir &) = delete;
+
+  const std::string &Path() const { return path_; }
+
+ private:
+  std::string path_{};
+};